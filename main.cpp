@@ -2,9 +2,68 @@
 #include <iomanip>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <stdexcept>
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <numeric>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_set>
+#include <optional>
+#include <deque>
+#include <thread>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <csignal>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <climits>
+#include <unistd.h>
+#define CURRENCY_CONVERTER_POSIX 1
+#else
+#include <fstream>
+#endif
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#define CURRENCY_CONVERTER_EPOLL 1
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CURRENCY_CONVERTER_X86_SIMD 1
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // ------------------------ Domain Layer ------------------------
 
@@ -24,278 +83,7246 @@ public:
     const std::string &getSymbol() const { return symbol; }
 };
 
-// ------------------------ Exchange Rate Layer ------------------------
+// One entry of the ISO 4217 currency list.
+struct IsoCurrency {
+    char code[4];             // alphabetic code, e.g. "USD"
+    std::uint16_t numeric;    // numeric code, e.g. 840
+    std::uint8_t minorUnits;  // decimals in amounts
+    const char *name;         // official name, e.g. "US Dollar"
+};
 
-class ExchangeRateProvider {
+// The ISO 4217 list of circulating currencies (plus CLF, the one common
+// unit with 4 decimals) as compile-time data, with a perfect hash over the
+// codes. A code packs into 15 bits (5 per letter); one multiply and shift of
+// that picks a slot in a 2 KiB table, found at compile time, in which no two
+// codes collide. find() is a pack, a multiply, two loads and a compare, with
+// no allocation, and is usable in constant expressions.
+class Iso4217 {
 public:
-    virtual ~ExchangeRateProvider() = default;
+    static constexpr std::uint32_t kNotPacked = 0xFFFFFFFF;
 
-    // returns multiplier for converting from -> to
-    virtual double getRate(const std::string &from, const std::string &to) const = 0;
+    // 15-bit form of a three-letter upper-case code, or kNotPacked
+    static constexpr std::uint32_t pack(std::string_view code) {
+        if (code.size() != 3) return kNotPacked;
+        auto first  = static_cast<std::uint32_t>(code[0] - 'A');   // wraps for anything below 'A'
+        auto second = static_cast<std::uint32_t>(code[1] - 'A');
+        auto third  = static_cast<std::uint32_t>(code[2] - 'A');
+        if (first >= 26 || second >= 26 || third >= 26) return kNotPacked;
+        return (first << 10) | (second << 5) | third;
+    }
 
-    // allow overriding rates at runtime (default: not supported)
-    virtual void setCustomRate(const std::string &from, const std::string &to, double rate) {
-        (void)from; (void)to; (void)rate;
-        throw std::runtime_error("Custom rates not supported by this provider");
+private:
+    static constexpr IsoCurrency kCurrencies[] = {
+        {"AED", 784, 2, "UAE Dirham"},
+        {"AFN", 971, 2, "Afghani"},
+        {"ALL",   8, 2, "Lek"},
+        {"AMD",  51, 2, "Armenian Dram"},
+        {"ANG", 532, 2, "Netherlands Antillean Guilder"},
+        {"AOA", 973, 2, "Kwanza"},
+        {"ARS",  32, 2, "Argentine Peso"},
+        {"AUD",  36, 2, "Australian Dollar"},
+        {"AWG", 533, 2, "Aruban Florin"},
+        {"AZN", 944, 2, "Azerbaijan Manat"},
+        {"BAM", 977, 2, "Convertible Mark"},
+        {"BBD",  52, 2, "Barbados Dollar"},
+        {"BDT",  50, 2, "Taka"},
+        {"BGN", 975, 2, "Bulgarian Lev"},
+        {"BHD",  48, 3, "Bahraini Dinar"},
+        {"BIF", 108, 0, "Burundi Franc"},
+        {"BMD",  60, 2, "Bermudian Dollar"},
+        {"BND",  96, 2, "Brunei Dollar"},
+        {"BOB",  68, 2, "Boliviano"},
+        {"BRL", 986, 2, "Brazilian Real"},
+        {"BSD",  44, 2, "Bahamian Dollar"},
+        {"BTN",  64, 2, "Ngultrum"},
+        {"BWP",  72, 2, "Pula"},
+        {"BYN", 933, 2, "Belarusian Ruble"},
+        {"BZD",  84, 2, "Belize Dollar"},
+        {"CAD", 124, 2, "Canadian Dollar"},
+        {"CDF", 976, 2, "Congolese Franc"},
+        {"CHF", 756, 2, "Swiss Franc"},
+        {"CLF", 990, 4, "Unidad de Fomento"},
+        {"CLP", 152, 0, "Chilean Peso"},
+        {"CNY", 156, 2, "Yuan Renminbi"},
+        {"COP", 170, 2, "Colombian Peso"},
+        {"CRC", 188, 2, "Costa Rican Colon"},
+        {"CUP", 192, 2, "Cuban Peso"},
+        {"CVE", 132, 2, "Cabo Verde Escudo"},
+        {"CZK", 203, 2, "Czech Koruna"},
+        {"DJF", 262, 0, "Djibouti Franc"},
+        {"DKK", 208, 2, "Danish Krone"},
+        {"DOP", 214, 2, "Dominican Peso"},
+        {"DZD",  12, 2, "Algerian Dinar"},
+        {"EGP", 818, 2, "Egyptian Pound"},
+        {"ERN", 232, 2, "Nakfa"},
+        {"ETB", 230, 2, "Ethiopian Birr"},
+        {"EUR", 978, 2, "Euro"},
+        {"FJD", 242, 2, "Fiji Dollar"},
+        {"FKP", 238, 2, "Falkland Islands Pound"},
+        {"GBP", 826, 2, "Pound Sterling"},
+        {"GEL", 981, 2, "Lari"},
+        {"GHS", 936, 2, "Ghana Cedi"},
+        {"GIP", 292, 2, "Gibraltar Pound"},
+        {"GMD", 270, 2, "Dalasi"},
+        {"GNF", 324, 0, "Guinean Franc"},
+        {"GTQ", 320, 2, "Quetzal"},
+        {"GYD", 328, 2, "Guyana Dollar"},
+        {"HKD", 344, 2, "Hong Kong Dollar"},
+        {"HNL", 340, 2, "Lempira"},
+        {"HTG", 332, 2, "Gourde"},
+        {"HUF", 348, 2, "Forint"},
+        {"IDR", 360, 2, "Rupiah"},
+        {"ILS", 376, 2, "New Israeli Sheqel"},
+        {"INR", 356, 2, "Indian Rupee"},
+        {"IQD", 368, 3, "Iraqi Dinar"},
+        {"IRR", 364, 2, "Iranian Rial"},
+        {"ISK", 352, 0, "Iceland Krona"},
+        {"JMD", 388, 2, "Jamaican Dollar"},
+        {"JOD", 400, 3, "Jordanian Dinar"},
+        {"JPY", 392, 0, "Yen"},
+        {"KES", 404, 2, "Kenyan Shilling"},
+        {"KGS", 417, 2, "Som"},
+        {"KHR", 116, 2, "Riel"},
+        {"KMF", 174, 0, "Comorian Franc"},
+        {"KPW", 408, 2, "North Korean Won"},
+        {"KRW", 410, 0, "Won"},
+        {"KWD", 414, 3, "Kuwaiti Dinar"},
+        {"KYD", 136, 2, "Cayman Islands Dollar"},
+        {"KZT", 398, 2, "Tenge"},
+        {"LAK", 418, 2, "Lao Kip"},
+        {"LBP", 422, 2, "Lebanese Pound"},
+        {"LKR", 144, 2, "Sri Lanka Rupee"},
+        {"LRD", 430, 2, "Liberian Dollar"},
+        {"LSL", 426, 2, "Loti"},
+        {"LYD", 434, 3, "Libyan Dinar"},
+        {"MAD", 504, 2, "Moroccan Dirham"},
+        {"MDL", 498, 2, "Moldovan Leu"},
+        {"MGA", 969, 2, "Malagasy Ariary"},
+        {"MKD", 807, 2, "Denar"},
+        {"MMK", 104, 2, "Kyat"},
+        {"MNT", 496, 2, "Tugrik"},
+        {"MOP", 446, 2, "Pataca"},
+        {"MRU", 929, 2, "Ouguiya"},
+        {"MUR", 480, 2, "Mauritius Rupee"},
+        {"MVR", 462, 2, "Rufiyaa"},
+        {"MWK", 454, 2, "Malawi Kwacha"},
+        {"MXN", 484, 2, "Mexican Peso"},
+        {"MYR", 458, 2, "Malaysian Ringgit"},
+        {"MZN", 943, 2, "Mozambique Metical"},
+        {"NAD", 516, 2, "Namibia Dollar"},
+        {"NGN", 566, 2, "Naira"},
+        {"NIO", 558, 2, "Cordoba Oro"},
+        {"NOK", 578, 2, "Norwegian Krone"},
+        {"NPR", 524, 2, "Nepalese Rupee"},
+        {"NZD", 554, 2, "New Zealand Dollar"},
+        {"OMR", 512, 3, "Rial Omani"},
+        {"PAB", 590, 2, "Balboa"},
+        {"PEN", 604, 2, "Sol"},
+        {"PGK", 598, 2, "Kina"},
+        {"PHP", 608, 2, "Philippine Peso"},
+        {"PKR", 586, 2, "Pakistan Rupee"},
+        {"PLN", 985, 2, "Zloty"},
+        {"PYG", 600, 0, "Guarani"},
+        {"QAR", 634, 2, "Qatari Rial"},
+        {"RON", 946, 2, "Romanian Leu"},
+        {"RSD", 941, 2, "Serbian Dinar"},
+        {"RUB", 643, 2, "Russian Ruble"},
+        {"RWF", 646, 0, "Rwanda Franc"},
+        {"SAR", 682, 2, "Saudi Riyal"},
+        {"SBD",  90, 2, "Solomon Islands Dollar"},
+        {"SCR", 690, 2, "Seychelles Rupee"},
+        {"SDG", 938, 2, "Sudanese Pound"},
+        {"SEK", 752, 2, "Swedish Krona"},
+        {"SGD", 702, 2, "Singapore Dollar"},
+        {"SHP", 654, 2, "Saint Helena Pound"},
+        {"SLE", 925, 2, "Leone"},
+        {"SOS", 706, 2, "Somali Shilling"},
+        {"SRD", 968, 2, "Surinam Dollar"},
+        {"SSP", 728, 2, "South Sudanese Pound"},
+        {"STN", 930, 2, "Dobra"},
+        {"SVC", 222, 2, "El Salvador Colon"},
+        {"SYP", 760, 2, "Syrian Pound"},
+        {"SZL", 748, 2, "Lilangeni"},
+        {"THB", 764, 2, "Baht"},
+        {"TJS", 972, 2, "Somoni"},
+        {"TMT", 934, 2, "Turkmenistan New Manat"},
+        {"TND", 788, 3, "Tunisian Dinar"},
+        {"TOP", 776, 2, "Pa'anga"},
+        {"TRY", 949, 2, "Turkish Lira"},
+        {"TTD", 780, 2, "Trinidad and Tobago Dollar"},
+        {"TWD", 901, 2, "New Taiwan Dollar"},
+        {"TZS", 834, 2, "Tanzanian Shilling"},
+        {"UAH", 980, 2, "Hryvnia"},
+        {"UGX", 800, 0, "Uganda Shilling"},
+        {"USD", 840, 2, "US Dollar"},
+        {"UYU", 858, 2, "Peso Uruguayo"},
+        {"UZS", 860, 2, "Uzbekistan Sum"},
+        {"VES", 928, 2, "Bolivar Soberano"},
+        {"VND", 704, 0, "Dong"},
+        {"VUV", 548, 0, "Vatu"},
+        {"WST", 882, 2, "Tala"},
+        {"XAF", 950, 0, "CFA Franc BEAC"},
+        {"XCD", 951, 2, "East Caribbean Dollar"},
+        {"XOF", 952, 0, "CFA Franc BCEAO"},
+        {"XPF", 953, 0, "CFP Franc"},
+        {"YER", 886, 2, "Yemeni Rial"},
+        {"ZAR", 710, 2, "Rand"},
+        {"ZMW", 967, 2, "Zambian Kwacha"},
+        {"ZWG", 924, 2, "Zimbabwe Gold"},
+    };
+    static constexpr std::size_t kCount = sizeof(kCurrencies) / sizeof(kCurrencies[0]);
+
+    static constexpr int kSlotBits = 11;
+    static_assert(kCount < 255, "slots hold an 8-bit index");
+
+    struct Index {
+        std::uint32_t multiplier = 0;                 // 0 = no collision-free multiplier found
+        std::uint8_t slots[std::size_t{1} << kSlotBits] = {};  // index + 1, 0 = empty
+    };
+
+    static constexpr std::size_t slotOf(std::uint32_t packed, std::uint32_t multiplier) {
+        return static_cast<std::uint32_t>(packed * multiplier) >> (32 - kSlotBits);
     }
-};
 
-class StaticRateProvider : public ExchangeRateProvider {
-    std::string baseCurrencyCode;                // all rates are stored relative to this base
-    std::map<std::string, double> baseRates;     // code -> rate vs base
-    std::map<std::string, double> customRates;   // "FROM->TO" -> rate
+    // tries odd multipliers until every code lands in its own slot
+    static constexpr Index buildIndex() {
+        std::uint32_t multiplier = 0x9E3779B1u;
+        for (int attempt = 0; attempt < 1000; ++attempt, multiplier = (multiplier + 0x6A09E668u) | 1u) {
+            Index index;
+            index.multiplier = multiplier;
+            bool collision = false;
+            for (std::size_t i = 0; i < kCount && !collision; ++i) {
+                std::uint8_t &slot = index.slots[slotOf(pack(kCurrencies[i].code), multiplier)];
+                collision = slot != 0;
+                slot = static_cast<std::uint8_t>(i + 1);
+            }
+            if (!collision) return index;
+        }
+        return Index{};
+    }
 
-    static std::string makeKey(const std::string &from, const std::string &to) {
-        return from + "->" + to;
+    static const Index kIndex;
+
+    // position of code in kCurrencies, or kCount if it is not listed; no
+    // pointers, so it stays usable in constant expressions on every compiler
+    static constexpr std::size_t indexOf(std::string_view code) {
+        std::uint32_t packed = pack(code);
+        if (packed == kNotPacked) return kCount;
+        std::uint8_t slot = kIndex.slots[slotOf(packed, kIndex.multiplier)];
+        if (slot == 0) return kCount;
+        const IsoCurrency &entry = kCurrencies[slot - 1];
+        return entry.code[0] == code[0] && entry.code[1] == code[1] && entry.code[2] == code[2]
+                   ? std::size_t{slot} - 1 : kCount;
     }
 
 public:
-    explicit StaticRateProvider(std::string baseCode = "USD")
-        : baseCurrencyCode(std::move(baseCode)) {
-            
-        // Hard-coded demo rates, for example only
-            
-        baseRates[baseCurrencyCode] = 1.0;  // base
-        baseRates["EUR"] = 0.92;            // 1 USD ≈ 0.92 EUR
-        baseRates["INR"] = 83.10;           // 1 USD ≈ 83.10 INR
-        baseRates["GBP"] = 0.79;            // 1 USD ≈ 0.79 GBP
-        baseRates["JPY"] = 141.50;          // 1 USD ≈ 141.50 JPY
-        baseRates["AUD"] = 1.47;            // 1 USD ≈ 1.47 AUD
-        baseRates["CAD"] = 1.34;            // 1 USD ≈ 1.34 CAD
+    // the entry for code, or nullptr if it is not an ISO 4217 code
+    static constexpr const IsoCurrency *find(std::string_view code) {
+        std::size_t i = indexOf(code);
+        return i == kCount ? nullptr : &kCurrencies[i];
     }
 
-    void registerCurrency(const std::string &code, double rateVsBase) {
-        baseRates[code] = rateVsBase;
+    static constexpr bool contains(std::string_view code) { return indexOf(code) != kCount; }
+
+    // decimals of an ISO code, or fallback for any other code
+    static constexpr int minorUnits(std::string_view code, int fallback = 2) {
+        std::size_t i = indexOf(code);
+        return i == kCount ? fallback : kCurrencies[i].minorUnits;
     }
 
-    std::vector<std::string> getSupportedCodes() const {
-        std::vector<std::string> codes;
-        codes.reserve(baseRates.size());
-        for (const auto &pair : baseRates) {
-            codes.push_back(pair.first);
+    static constexpr const IsoCurrency *begin() { return kCurrencies; }
+    static constexpr const IsoCurrency *end() { return kCurrencies + kCount; }
+    static constexpr std::size_t size() { return kCount; }
+
+    // true if every code resolves to its own entry (checked at compile time below)
+    static constexpr bool complete() {
+        for (std::size_t i = 0; i < kCount; ++i) {
+            if (indexOf(kCurrencies[i].code) != i) return false;
         }
-        return codes;
+        return kIndex.multiplier != 0;
     }
+};
 
-    double getRate(const std::string &from, const std::string &to) const override {
-        if (from == to) return 1.0;
+constexpr Iso4217::Index Iso4217::kIndex = Iso4217::buildIndex();
+static_assert(Iso4217::complete() && !Iso4217::contains("XYZ") && Iso4217::minorUnits("JPY") == 0,
+              "ISO 4217 index must resolve every listed code");
 
-        // Check custom override first
-        auto customIt = customRates.find(makeKey(from, to));
-        if (customIt != customRates.end()) {
-            return customIt->second;
-        }
+// Dense integer handle for a currency code, assigned by CurrencyRegistry.
+using CurrencyId = std::uint32_t;
+constexpr CurrencyId kInvalidCurrencyId = std::numeric_limits<CurrencyId>::max();
 
-        auto itFrom = baseRates.find(from);
-        auto itTo   = baseRates.find(to);
+// Packs an ordered (from, to) pair into one integer key; no allocation needed.
+inline std::uint64_t pairKey(CurrencyId from, CurrencyId to) {
+    return (static_cast<std::uint64_t>(from) << 32) | to;
+}
 
-        if (itFrom == baseRates.end() || itTo == baseRates.end()) {
-            throw std::runtime_error("Unsupported currency code");
-        }
+struct CurrencyPair {
+    CurrencyId from;
+    CurrencyId to;
+};
 
-        double rateFrom = itFrom->second; // from vs base
-        double rateTo   = itTo->second;   // to vs base
+// Failure reasons reported by the non-throwing (try*) API.
+enum class ConversionError {
+    None,
+    UnsupportedCurrency,
+    NegativeAmount,
+    AmountOutOfRange,
+    NoRateAtTime,
+    OutOfMemory,
+};
 
-        // Convert: from -> base -> to
-        return rateTo / rateFrom;
+inline const char *describe(ConversionError error) {
+    switch (error) {
+        case ConversionError::None:                return "OK";
+        case ConversionError::UnsupportedCurrency: return "Unsupported currency code";
+        case ConversionError::NegativeAmount:      return "Amount cannot be negative";
+        case ConversionError::AmountOutOfRange:    return "Amount out of range";
+        case ConversionError::NoRateAtTime:        return "No rate recorded at or before that time";
+        case ConversionError::OutOfMemory:         return "Out of memory";
     }
+    return "Unknown error";
+}
 
-    void setCustomRate(const std::string &from, const std::string &to, double rate) override {
-        if (rate <= 0.0) {
-            throw std::runtime_error("Rate must be positive");
+// Either a value or the reason there is none; a small stand-in for
+// std::expected, which is not available in C++17.
+template <typename T>
+class Result {
+    T val{};
+    ConversionError err = ConversionError::None;
+
+public:
+    Result(T value) : val(value) {}
+    Result(ConversionError error) : err(error) {}
+
+    bool ok() const { return err == ConversionError::None; }
+    explicit operator bool() const { return ok(); }
+
+    T value() const { return val; }
+    ConversionError error() const { return err; }
+
+    // bridge for the throwing API
+    T valueOrThrow() const {
+        if (!ok()) {
+            throw std::runtime_error(describe(err));
         }
-        customRates[makeKey(from, to)] = rate;
+        return val;
     }
 };
 
-// ------------------------ Application Layer ------------------------
-
-class CurrencyConverter {
-    ExchangeRateProvider &rateProvider;
+// Locale-independent text conversion of amounts and rates, shared by every
+// text-facing mode (interactive, batch, CSV pipeline).
+//
+// Plain decimals ("1234.56") parse on an exact fast path: when the digits fit
+// in 53 bits and there are at most 22 decimals, digits / 10^decimals is a
+// single correctly rounded division. Anything else (exponents, long inputs)
+// goes to std::from_chars, so both paths give the same double.
+//
+// Fixed-point output rounds through 64-bit integers. Values too large for
+// that, and values so close to a rounding tie that the scaled product cannot
+// decide it, go to std::to_chars; the text always matches printf("%.*f").
+class AmountText {
+    static constexpr double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
 
 public:
-    explicit CurrencyConverter(ExchangeRateProvider &provider)
-        : rateProvider(provider) {}
+    static constexpr int kMaxDecimals = 18;
+    // longest formatFixed output: sign, 309 integer digits, point, decimals
+    static constexpr std::size_t kMaxFixedLength = 1 + 309 + 1 + kMaxDecimals;
 
-    double convert(const std::string &from, const std::string &to, double amount) const {
-        if (amount < 0.0) {
-            throw std::runtime_error("Amount cannot be negative");
+    // Parses the whole of [first, last) as a decimal number ("12", "-0.5",
+    // "1e6"); false if it is not one, or if it is nan, infinite or overflows.
+    static bool parse(const char *first, const char *last, double &value) noexcept {
+        const char *p = first;
+        bool negative = p != last && *p == '-';
+        if (negative) ++p;
+
+        std::uint64_t digits = 0;
+        int count = 0, decimals = 0;
+        for (; p != last && static_cast<unsigned>(*p - '0') < 10; ++p, ++count) {
+            digits = digits * 10 + static_cast<unsigned>(*p - '0');
+        }
+        if (p != last && *p == '.') {
+            for (++p; p != last && static_cast<unsigned>(*p - '0') < 10; ++p, ++count, ++decimals) {
+                digits = digits * 10 + static_cast<unsigned>(*p - '0');
+            }
         }
-        double rate = rateProvider.getRate(from, to);
-        return amount * rate;
+        if (p == last && count > 0 && count <= 19 && decimals <= 22 &&
+            digits <= (std::uint64_t{1} << 53)) {
+            double magnitude = static_cast<double>(digits) / kPow10[decimals];
+            value = negative ? -magnitude : magnitude;
+            return true;
+        }
+
+        double parsed = 0.0;
+        auto result = std::from_chars(first, last, parsed);
+        if (result.ec != std::errc() || result.ptr != last || !std::isfinite(parsed)) return false;
+        value = parsed;
+        return true;
     }
-};
 
-// ------------------------ Presentation / UI Layer ------------------------
+    static bool parse(const std::string &text, double &value) noexcept {
+        return parse(text.data(), text.data() + text.size(), value);
+    }
 
-class ConverterApp {
-    StaticRateProvider rateProvider;
-    CurrencyConverter  converter;
-    std::map<std::string, Currency> currencies;
+    // Writes units / 10^decimals, e.g. (123450, 2) -> "1234.50"; returns the
+    // end. out needs room for 21 + decimals bytes.
+    static char *formatMinor(char *out, std::int64_t units, int decimals) noexcept {
+        std::uint64_t magnitude = units < 0 ? 0 - static_cast<std::uint64_t>(units)
+                                            : static_cast<std::uint64_t>(units);
+        if (units < 0) *out++ = '-';
+        return writeScaled(out, magnitude, decimals);
+    }
 
+    // Writes value rounded to decimals digits after the point (0 to
+    // kMaxDecimals), exactly as printf("%.*f") would; returns the end. out
+    // needs kMaxFixedLength bytes.
+    static char *formatFixed(char *out, double value, int decimals) noexcept {
+        decimals = std::min(std::max(decimals, 0), kMaxDecimals);
+        double scaled = std::fabs(value) * kPow10[decimals];
+        if (scaled < 0x1p53) {
+            // below 2^53 the split into whole and fraction is exact, and the
+            // product is off by at most half an ulp: ties within that margin
+            // are left to to_chars, which rounds the exact binary value
+            double whole    = std::floor(scaled);
+            double fraction = scaled - whole;
+            if (std::fabs(fraction - 0.5) > scaled * 0x1p-52) {
+                if (std::signbit(value)) *out++ = '-';
+                auto units = static_cast<std::uint64_t>(whole) + (fraction > 0.5 ? 1 : 0);
+                return writeScaled(out, units, decimals);
+            }
+        }
+        return std::to_chars(out, out + kMaxFixedLength, value, std::chars_format::fixed, decimals).ptr;
+    }
+
+    static std::string toFixed(double value, int decimals) {
+        char text[kMaxFixedLength];
+        return std::string(text, formatFixed(text, value, decimals));
+    }
+
+private:
+    // magnitude / 10^decimals with exactly `decimals` digits after the point
+    static char *writeScaled(char *out, std::uint64_t magnitude, int decimals) noexcept {
+        char digits[20];
+        char *end = std::to_chars(digits, digits + sizeof(digits), magnitude).ptr;
+        auto length = static_cast<int>(end - digits);
+        if (decimals <= 0) {
+            std::memcpy(out, digits, static_cast<std::size_t>(length));
+            return out + length;
+        }
+        int whole = length - decimals;
+        if (whole <= 0) {
+            *out++ = '0';
+            *out++ = '.';
+            std::memset(out, '0', static_cast<std::size_t>(-whole));
+            out += -whole;
+            std::memcpy(out, digits, static_cast<std::size_t>(length));
+            return out + length;
+        }
+        std::memcpy(out, digits, static_cast<std::size_t>(whole));
+        out += whole;
+        *out++ = '.';
+        std::memcpy(out, digits + whole, static_cast<std::size_t>(decimals));
+        return out + decimals;
+    }
+};
+
+// Append-only set of interned strings: each distinct text is stored once,
+// back to back in one buffer, and named by a dense handle (0, 1, 2, ...).
+// Holds the cold, rarely read text of currencies (codes as text, names,
+// symbols), so thousands of them are three flat arrays instead of thousands
+// of small heap strings.
+class StringPool {
 public:
-    ConverterApp()
-        : rateProvider("USD"), converter(rateProvider) {
-        seedCurrencies();
+    using Handle = std::uint32_t;
+
+private:
+    std::string text;                          // every string, back to back
+    std::vector<std::uint32_t> offsets{0};     // handle -> start; one extra entry marks the end
+    std::vector<Handle> index;                 // open addressing; handle + 1, 0 = empty
+
+    static std::uint64_t hashOf(std::string_view s) {
+        std::uint64_t hash = 1469598103934665603ull;
+        for (char c : s) hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        return hash;
     }
 
-    void run() {
-        bool running = true;
-        while (running) {
-            printMainMenu();
-            int choice = readInt("Choose an option: ");
-            std::cout << "\n";
+    void rehash(std::size_t slots) {
+        std::vector<Handle> grown(slots, 0);
+        for (Handle h = 0; h < size(); ++h) {
+            std::size_t i = hashOf(view(h)) & (slots - 1);
+            while (grown[i] != 0) i = (i + 1) & (slots - 1);
+            grown[i] = h + 1;
+        }
+        index = std::move(grown);
+    }
 
-            try {
-                switch (choice) {
-                    case 1:
-                        handleConvert();
-                        break;
-                    case 2:
-                        handleListCurrencies();
-                        break;
-                    case 3:
-                        handleCustomRate();
-                        break;
-                    case 4:
-                        printAbout();
-                        break;
-                    case 0:
-                        running = false;
-                        break;
-                    default:
-                        std::cout << "Unknown choice. Try again.\n";
+public:
+    Handle intern(std::string_view s) {
+        if ((size() + 1) * 2 > index.size()) rehash(std::max<std::size_t>(16, index.size() * 2));
+        std::size_t mask = index.size() - 1;
+        for (std::size_t i = hashOf(s) & mask;; i = (i + 1) & mask) {
+            if (index[i] == 0) {
+                if (text.size() + s.size() > std::numeric_limits<std::uint32_t>::max()) {
+                    throw std::length_error("string pool full");
                 }
-            } catch (const std::exception &ex) {
-                std::cout << "Error: " << ex.what() << "\n";
+                text.append(s.data(), s.size());
+                offsets.push_back(static_cast<std::uint32_t>(text.size()));
+                index[i] = static_cast<Handle>(size());
+                return index[i] - 1;
             }
+            if (view(index[i] - 1) == s) return index[i] - 1;
+        }
+    }
 
-            if (running) {
-                std::cout << "\nPress ENTER to continue...";
-                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                std::cin.get();
-                std::cout << "\n";
+    std::string_view view(Handle h) const {
+        return std::string_view(text.data() + offsets[h], offsets[h + 1] - offsets[h]);
+    }
+
+    std::size_t size() const { return offsets.size() - 1; }
+};
+
+// Interns currency codes into dense ids (0, 1, 2, ...) so hot paths can index
+// arrays instead of comparing strings. Ids are never reused or removed.
+//
+// Lookups touch one flat table of 16-byte slots (four to a cache line): a
+// code of up to 8 bytes, which covers ISO codes and every code a rate book
+// can hold, is packed into one integer next to its id, so finding "EUR" is a
+// multiply, a load and an integer compare, and the slots of 10,000
+// currencies (256 KiB) stay in L2. Longer codes still work; their slot holds
+// a hash and a match is confirmed against the text. The text lives in a
+// StringPool, off the lookup path.
+class CurrencyRegistry {
+    struct alignas(16) Slot {
+        std::uint64_t key = 0;                // packed code, or a hash of a longer one
+        CurrencyId id = kInvalidCurrencyId;   // kInvalidCurrencyId = empty
+        std::uint32_t length = 0;             // of the code
+    };
+
+    std::vector<Slot> slots;                  // power-of-two size, at most half full
+    StringPool codes;                         // id -> code; handles equal ids
+
+    static std::uint64_t keyOf(const std::string &code) {
+        std::uint64_t key = 0;
+        if (code.size() <= sizeof(key)) {
+            for (std::size_t i = 0; i < code.size(); ++i) {
+                key |= static_cast<std::uint64_t>(static_cast<unsigned char>(code[i])) << (8 * i);
             }
+            return key;
         }
+        key = 1469598103934665603ull;
+        for (char c : code) key = (key ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        return key;
+    }
 
-        std::cout << "Goodbye!" << std::endl;
+    std::size_t slotOf(std::uint64_t key) const {
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots.size() - 1);
     }
 
-private:
-    static int readInt(const std::string &prompt) {
-        int value;
-        while (true) {
-            std::cout << prompt;
-            if (std::cin >> value) {
-                return value;
-            }
-            std::cout << "Invalid number. Try again.\n";
-            std::cin.clear();
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    bool matches(const Slot &slot, std::uint64_t key, const std::string &code) const {
+        return slot.key == key && slot.length == code.size() &&
+               (code.size() <= sizeof(key) || codes.view(slot.id) == code);
+    }
+
+    void rehash(std::size_t count) {
+        std::vector<Slot> old = std::move(slots);
+        slots.assign(count, Slot{});
+        for (const Slot &slot : old) {
+            if (slot.id == kInvalidCurrencyId) continue;
+            std::size_t i = slotOf(slot.key);
+            while (slots[i].id != kInvalidCurrencyId) i = (i + 1) & (slots.size() - 1);
+            slots[i] = slot;
         }
     }
 
-    static double readDouble(const std::string &prompt) {
-        double value;
-        while (true) {
-            std::cout << prompt;
-            if (std::cin >> value) {
-                return value;
+public:
+    CurrencyId intern(const std::string &code) {
+        if ((size() + 1) * 2 > slots.size()) rehash(std::max<std::size_t>(16, slots.size() * 2));
+        std::uint64_t key = keyOf(code);
+        for (std::size_t i = slotOf(key);; i = (i + 1) & (slots.size() - 1)) {
+            Slot &slot = slots[i];
+            if (slot.id == kInvalidCurrencyId) {
+                slot = {key, static_cast<CurrencyId>(codes.intern(code)),
+                        static_cast<std::uint32_t>(code.size())};
+                return slot.id;
             }
-            std::cout << "Invalid number. Try again.\n";
-            std::cin.clear();
-            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            if (matches(slot, key, code)) return slot.id;
         }
     }
 
-    static std::string readCode(const std::string &prompt) {
-        std::string code;
-        std::cout << prompt;
-        std::cin >> code;
-        for (char &c : code) c = static_cast<char>(toupper(c));
-        return code;
+    // kInvalidCurrencyId if the code was never interned
+    CurrencyId find(const std::string &code) const {
+        if (slots.empty()) return kInvalidCurrencyId;
+        std::uint64_t key = keyOf(code);
+        for (std::size_t i = slotOf(key);; i = (i + 1) & (slots.size() - 1)) {
+            const Slot &slot = slots[i];
+            if (slot.id == kInvalidCurrencyId) return kInvalidCurrencyId;
+            if (matches(slot, key, code)) return slot.id;
+        }
     }
 
-    void seedCurrencies() {
-        // In a larger system, this could be loaded from a database or config file
-        registerCurrency({"USD", "US Dollar", "$"});
-        registerCurrency({"EUR", "Euro", "€"});
-        registerCurrency({"INR", "Indian Rupee", "₹"});
-        registerCurrency({"GBP", "British Pound", "£"});
-        registerCurrency({"JPY", "Japanese Yen", "¥"});
-        registerCurrency({"AUD", "Australian Dollar", "$"});
-        registerCurrency({"CAD", "Canadian Dollar", "$"});
+    std::string getCode(CurrencyId id) const {
+        if (id >= size()) throw std::out_of_range("Unknown currency id");
+        return std::string(codes.view(id));
     }
 
-    void registerCurrency(const Currency &currency) {
-        currencies[currency.getCode()] = currency;
+    std::size_t size() const { return codes.size(); }
+};
+
+// Names and symbols of the currencies an app displays, kept apart from the
+// rates. A code resolves through a CurrencyRegistry to a row, and a row is
+// two StringPool handles, so text shared by several currencies ("$",
+// "Dollar" names repeated by feeds) is stored once.
+class CurrencyTable {
+    CurrencyRegistry rows;                        // code -> row
+    StringPool text;                              // names and symbols
+    std::vector<StringPool::Handle> names, symbols;
+
+public:
+    // adds a currency, or replaces the name and symbol of a known code
+    void add(const Currency &currency) {
+        CurrencyId row = rows.intern(currency.getCode());
+        if (row == names.size()) {
+            names.push_back(0);
+            symbols.push_back(0);
+        }
+        names[row]   = text.intern(currency.getName());
+        symbols[row] = text.intern(currency.getSymbol());
     }
 
-    void printMainMenu() {
-        std::cout << "==============================\n";
-        std::cout << "   Smart Currency Converter\n";
-        std::cout << "==============================\n";
-        std::cout << "1. Convert amount\n";
-        std::cout << "2. List supported currencies\n";
-        std::cout << "3. Override custom exchange rate\n";
-        std::cout << "4. About this tool\n";
-        std::cout << "0. Exit\n";
+    bool contains(const std::string &code) const { return rows.find(code) != kInvalidCurrencyId; }
+
+    // the currency with this code, if the table has one
+    std::optional<Currency> find(const std::string &code) const {
+        CurrencyId row = rows.find(code);
+        if (row == kInvalidCurrencyId) return std::nullopt;
+        return get(row);
     }
 
-    void handleConvert() {
-        std::cout << "--- Convert Amount ---\n";
-        std::string from = readCode("From currency code (e.g. USD): ");
-        std::string to   = readCode("To currency code (e.g. INR): ");
-        double amount    = readDouble("Amount: ");
+    Currency get(CurrencyId row) const {
+        return Currency(rows.getCode(row), std::string(text.view(names.at(row))),
+                        std::string(text.view(symbols.at(row))));
+    }
+
+    std::size_t size() const { return names.size(); }
+
+    // rows ordered by code, for listings
+    std::vector<CurrencyId> byCode() const {
+        std::vector<std::string> codes(size());
+        std::vector<CurrencyId> order(size());
+        for (CurrencyId row = 0; row < size(); ++row) {
+            codes[row] = rows.getCode(row);
+            order[row] = row;
+        }
+        std::sort(order.begin(), order.end(),
+                  [&codes](CurrencyId a, CurrencyId b) { return codes[a] < codes[b]; });
+        return order;
+    }
 
-        double result = converter.convert(from, to, amount);
+    void clear() { *this = CurrencyTable(); }
+};
+
+// Exact amount of one currency: an integer count of its minor unit (cents for
+// USD, yen for JPY). How many decimals a currency has is supplied by its
+// provider (ExchangeRateProvider::getMinorUnits).
+class Money {
+    std::int64_t minorAmount = 0;
+    CurrencyId currency = kInvalidCurrencyId;
 
-        auto itFrom = currencies.find(from);
-        auto itTo   = currencies.find(to);
+public:
+    Money() = default;
+    Money(std::int64_t amountInMinorUnits, CurrencyId currencyId)
+        : minorAmount(amountInMinorUnits), currency(currencyId) {}
 
-        std::cout << std::fixed << std::setprecision(2);
-        std::cout << "\n" << amount << " "
-                  << (itFrom != currencies.end() ? itFrom->second.getCode() : from)
-                  << " = " << result << " "
-                  << (itTo != currencies.end() ? itTo->second.getCode() : to) << "\n";
+    // nearest representable amount, for values entered as decimals;
+    // AmountOutOfRange for nan, infinities and amounts past 64-bit minor units
+    static Result<Money> fromDecimal(double amount, CurrencyId currencyId, int minorUnits) {
+        double scaled = amount * std::pow(10.0, minorUnits);
+        if (!(std::fabs(scaled) < 0x1p63)) return ConversionError::AmountOutOfRange;
+        return Money(std::llround(scaled), currencyId);
     }
 
-    void handleListCurrencies() {
-        std::cout << "--- Supported Currencies ---\n";
-        std::cout << std::left << std::setw(8)  << "Code"
-                  << std::setw(20) << "Name"
-                  << "Symbol" << "\n";
-        std::cout << "-------------------------------------\n";
-        for (const auto &pair : currencies) {
-            const Currency &c = pair.second;
-            std::cout << std::left << std::setw(8)  << c.getCode()
-                      << std::setw(20) << c.getName()
-                      << c.getSymbol() << "\n";
+    std::int64_t getMinorAmount() const { return minorAmount; }
+    CurrencyId getCurrency() const { return currency; }
+
+    // e.g. "1234.50" for minorUnits = 2, "1235" for minorUnits = 0
+    std::string toString(int minorUnits) const {
+        char text[24 + AmountText::kMaxDecimals];
+        return std::string(text, AmountText::formatMinor(text, minorAmount,
+                                                         std::min(minorUnits, AmountText::kMaxDecimals)));
+    }
+};
+
+// Decimal form of a rate, mantissa / 10^scale with 15 significant digits, so
+// Money conversions can run in integer arithmetic. 83.10 becomes exactly
+// 83100000000000 / 10^12 even though the double is 83.0999...
+struct FixedRate {
+    std::int64_t mantissa = 0;  // 0 = no usable rate
+    int scale = 0;
+
+    static FixedRate fromDouble(double rate) {
+        FixedRate fixed;
+        if (!(rate > 0.0) || !std::isfinite(rate)) return fixed;
+
+        double scaled = rate;
+        while (scaled < 1e14 && fixed.scale < 24) {
+            scaled *= 10.0;
+            ++fixed.scale;
+        }
+        while (scaled >= 1e15 && fixed.scale > -4) {
+            scaled /= 10.0;
+            --fixed.scale;
+        }
+        fixed.mantissa = std::llround(scaled);
+
+        // fewest digits, so typical rates (e.g. 141.5 = 1415 / 10^1) keep the
+        // product of amount and mantissa within 64 bits
+        while (fixed.mantissa % 10 == 0 && fixed.scale > -4) {
+            fixed.mantissa /= 10;
+            --fixed.scale;
         }
+        return fixed;
     }
+};
 
-    void handleCustomRate() {
-        std::cout << "--- Custom Exchange Rate ---\n";
-        std::string from = readCode("From currency code: ");
-        std::string to   = readCode("To currency code: ");
-        double rate      = readDouble("Custom rate (1 " + from + " = ? " + to + "): ");
+// Converts amounts in minor units of one currency into minor units of another
+// at a fixed rate, rounding half away from zero. Set up once per rate, then
+// apply() is pure integer arithmetic. Uses 128-bit integers where the compiler
+// has them; elsewhere falls back to long double, exact only up to its
+// mantissa width.
+#ifdef __SIZEOF_INT128__
+__extension__ typedef __int128 i128;  // __extension__: no -Wpedantic warning
+#endif
 
-        rateProvider.setCustomRate(from, to, rate);
-        std::cout << "Custom rate updated. Future conversions will use this rate.\n";
+class MinorUnitConversion {
+    std::int64_t mantissa;
+    int shift;                  // result = amount * mantissa / 10^shift
+    bool usable;
+    std::int64_t pow10Small = 0;  // 10^shift when 0 <= shift <= 18, for the 64-bit path
+    std::int64_t narrowLimit = 0; // largest |amount| whose product fits in 64 bits
+#ifdef __SIZEOF_INT128__
+    i128 pow10 = 1;         // 10^|shift|
+#endif
+
+    static std::int64_t roundedQuotient(std::int64_t product, std::int64_t divisor) {
+        std::int64_t result    = product / divisor;
+        std::int64_t remainder = product % divisor;
+        if (remainder < 0) remainder = -remainder;
+        if (remainder >= divisor - remainder) {
+            result += product < 0 ? -1 : 1;
+        }
+        return result;
     }
 
-    void printAbout() {
-        std::cout << "--- About ---\n";
-        std::cout << "This demo shows an object-oriented design in C++.\n";
-        std::cout << "Key concepts used:\n";
-        std::cout << " - Encapsulation via Currency, StaticRateProvider, CurrencyConverter classes\n";
-        std::cout << " - Inheritance and polymorphism via ExchangeRateProvider interface\n";
-        std::cout << " - Separation of concerns (domain, application, UI layers)\n";
+public:
+    MinorUnitConversion() : mantissa(0), shift(0), usable(false) {}
+
+    MinorUnitConversion(FixedRate rate, int fromUnits, int toUnits)
+        : mantissa(rate.mantissa), shift(rate.scale + fromUnits - toUnits),
+          usable(rate.mantissa != 0 && shift >= -18 && shift <= 38) {
+        if (usable && shift >= 0 && shift <= 18) {
+            narrowLimit = std::numeric_limits<std::int64_t>::max() / mantissa;
+            pow10Small = 1;
+            for (int i = 0; i < shift; ++i) pow10Small *= 10;
+        }
+#ifdef __SIZEOF_INT128__
+        for (int i = 0; usable && i < std::abs(shift); ++i) pow10 *= 10;
+#endif
+    }
+
+    Result<std::int64_t> apply(std::int64_t amount) const {
+        if (!usable) return ConversionError::UnsupportedCurrency;
+
+        // common case: the product fits in 64 bits
+        if (pow10Small != 0 && amount <= narrowLimit && amount >= -narrowLimit) {
+            return roundedQuotient(amount * mantissa, pow10Small);
+        }
+#ifdef __SIZEOF_INT128__
+        i128 product = static_cast<i128>(amount) * mantissa;
+        i128 result;
+        if (shift >= 0) {
+            result = product / pow10;
+            i128 remainder = product % pow10;
+            if (remainder < 0) remainder = -remainder;
+            if (remainder >= pow10 - remainder) {
+                result += product < 0 ? -1 : 1;
+            }
+        } else {
+            // bounded before multiplying: an i128 overflow would be undefined
+            if (product > std::numeric_limits<std::int64_t>::max() / pow10 ||
+                product < std::numeric_limits<std::int64_t>::min() / pow10) {
+                return ConversionError::AmountOutOfRange;
+            }
+            result = product * pow10;
+        }
+
+        if (result > std::numeric_limits<std::int64_t>::max() ||
+            result < std::numeric_limits<std::int64_t>::min()) {
+            return ConversionError::AmountOutOfRange;
+        }
+        return static_cast<std::int64_t>(result);
+#else
+        long double result = std::round(static_cast<long double>(amount) * mantissa /
+                                        std::pow(10.0L, shift));
+        if (std::fabs(result) >= 9.2e18L) return ConversionError::AmountOutOfRange;
+        return static_cast<std::int64_t>(result);
+#endif
+    }
+};
+
+// ------------------------ Exchange Rate Layer ------------------------
+
+// Square table of final cross rates, indexed [from][to]. Every row starts on a
+// cache-line boundary, so a lookup is a single aligned load. Rows are padded to
+// a spare capacity that grows geometrically as currencies are added.
+//
+// Copies share their rows: a copy costs one pointer per row, and the first
+// write to a row in a copy clones that row alone. Rows shared with another
+// copy are never written, so a published table can be read while the next
+// version is being built from it.
+class CrossRateMatrix {
+    static constexpr std::size_t kCacheLine = 64;
+    static constexpr std::size_t kDoublesPerLine = kCacheLine / sizeof(double);
+
+    struct AlignedDelete {
+        void operator()(double *p) const {
+            ::operator delete[](p, std::align_val_t(kCacheLine));
+        }
+    };
+
+    std::size_t dim = 0;     // currencies covered
+    std::size_t stride = 0;  // allocated row length in doubles
+    std::vector<std::shared_ptr<double>> rows;
+    std::vector<bool> owned;  // row written by this copy only, safe to modify
+
+    // a row of stride cells holding the first dim cells of source (or none)
+    std::shared_ptr<double> makeRow(const double *source) const {
+        std::shared_ptr<double> row(
+            static_cast<double *>(::operator new[](stride * sizeof(double), std::align_val_t(kCacheLine))),
+            AlignedDelete());
+        std::size_t kept = source ? dim : 0;
+        if (kept) std::memcpy(row.get(), source, kept * sizeof(double));
+        std::fill(row.get() + kept, row.get() + stride, 0.0);
+        return row;
+    }
+
+public:
+    CrossRateMatrix() = default;
+
+    CrossRateMatrix(const CrossRateMatrix &other)
+        : dim(other.dim), stride(other.stride), rows(other.rows), owned(other.rows.size(), false) {}
+
+    CrossRateMatrix &operator=(const CrossRateMatrix &) = delete;
+
+    std::size_t size() const { return dim; }
+
+    // grows to n x n; new cells start at 0.0 (no rate)
+    void resize(std::size_t n) {
+        if (n <= dim) return;
+        if (n > stride) {
+            std::size_t newStride = std::max(n, stride * 2);
+            newStride = (newStride + kDoublesPerLine - 1) / kDoublesPerLine * kDoublesPerLine;
+            stride = newStride;
+            for (std::size_t row = 0; row < dim; ++row) {
+                rows[row] = makeRow(rows[row].get());
+                owned[row] = true;
+            }
+        }
+
+        // cells [dim, n) of existing rows are still 0.0: no copy wrote past its dim
+        std::size_t oldDim = dim;
+        dim = n;
+        rows.resize(n);
+        owned.resize(n, true);
+        for (std::size_t row = oldDim; row < n; ++row) rows[row] = makeRow(nullptr);
+    }
+
+    double at(std::size_t from, std::size_t to) const { return rows[from].get()[to]; }
+    double &at(std::size_t from, std::size_t to) { return writableRow(from)[to]; }
+    const double *row(std::size_t from) const { return rows[from].get(); }
+
+    // a row this copy may modify, cloned first if it is still shared
+    double *writableRow(std::size_t from) {
+        if (!owned[from]) {
+            rows[from] = makeRow(rows[from].get());
+            owned[from] = true;
+        }
+        return rows[from].get();
     }
 };
 
-int main() {
-    ConverterApp app;
-    app.run();
+// Custom overrides keyed by pairKey, split by hash into chunks that copies
+// share the way CrossRateMatrix shares rows: a write clones one chunk of at
+// most about kChunkEntries entries. The chunk count doubles as the map grows.
+class OverrideMap {
+    using Chunk = std::unordered_map<std::uint64_t, double>;
+    static constexpr std::size_t kChunkEntries = 64;
+
+    std::vector<std::shared_ptr<Chunk>> chunks{std::make_shared<Chunk>()};
+    std::vector<bool> owned = std::vector<bool>(1, true);
+    std::size_t count = 0;
+    unsigned shift = 64;  // chunk index = mixed key >> shift
+
+    std::size_t chunkOf(std::uint64_t key) const {
+        return shift == 64 ? 0 : static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void grow() {
+        std::vector<std::shared_ptr<Chunk>> old = std::move(chunks);
+        --shift;
+        chunks.assign(old.size() * 2, nullptr);
+        for (std::shared_ptr<Chunk> &chunk : chunks) chunk = std::make_shared<Chunk>();
+        owned.assign(chunks.size(), true);
+        for (const std::shared_ptr<Chunk> &chunk : old) {
+            for (const auto &entry : *chunk) (*chunks[chunkOf(entry.first)])[entry.first] = entry.second;
+        }
+    }
+
+public:
+    OverrideMap() = default;
+
+    OverrideMap(const OverrideMap &other)
+        : chunks(other.chunks), owned(other.chunks.size(), false), count(other.count), shift(other.shift) {}
+
+    OverrideMap &operator=(const OverrideMap &) = delete;
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // the override for a pair, or nullptr
+    const double *find(std::uint64_t key) const {
+        const Chunk &chunk = *chunks[chunkOf(key)];
+        auto it = chunk.find(key);
+        return it == chunk.end() ? nullptr : &it->second;
+    }
+
+    void set(std::uint64_t key, double rate) {
+        std::size_t index = chunkOf(key);
+        if (!owned[index]) {
+            chunks[index] = std::make_shared<Chunk>(*chunks[index]);
+            owned[index] = true;
+        }
+        if (chunks[index]->insert_or_assign(key, rate).second &&
+            ++count > chunks.size() * kChunkEntries) {
+            grow();
+        }
+    }
+
+    // every (pairKey, rate), in no particular order
+    std::vector<std::pair<std::uint64_t, double>> entries() const {
+        std::vector<std::pair<std::uint64_t, double>> all;
+        all.reserve(count);
+        for (const std::shared_ptr<Chunk> &chunk : chunks) all.insert(all.end(), chunk->begin(), chunk->end());
+        return all;
+    }
+};
+
+// Changes staged for one atomic publish: a provider applies all of them as a
+// single new version, and anything derived from the rates (cross-rate matrix,
+// memoised paths, quote caches) is brought up to date once for the whole set.
+// Later entries win over earlier ones for the same currency or pair.
+class RateUpdate {
+public:
+    struct CurrencyChange {
+        std::string code;
+        double rateVsBase;
+        int minorUnits;
+    };
+
+    struct OverrideChange {
+        std::string from;
+        std::string to;
+        double rate;
+    };
+
+private:
+    std::vector<CurrencyChange> currencyChanges;
+    std::vector<OverrideChange> overrideChanges;
+
+public:
+    // checked here too; a rate of 0 is allowed and means "no rate yet"
+    RateUpdate &registerCurrency(const std::string &code, double rateVsBase, int minorUnits = 2) {
+        if (!(rateVsBase >= 0.0) || !std::isfinite(rateVsBase)) {
+            throw std::runtime_error("Rate must be positive");
+        }
+        if (minorUnits < 0 || minorUnits > AmountText::kMaxDecimals) {
+            throw std::runtime_error("Minor units must be between 0 and 18");
+        }
+        currencyChanges.push_back({code, rateVsBase, minorUnits});
+        return *this;
+    }
+
+    // checked here, so a staged update cannot fail halfway through applying
+    RateUpdate &setCustomRate(const std::string &from, const std::string &to, double rate) {
+        if (!(rate > 0.0) || !std::isfinite(rate)) {
+            throw std::runtime_error("Rate must be positive");
+        }
+        overrideChanges.push_back({from, to, rate});
+        return *this;
+    }
+
+    const std::vector<CurrencyChange> &currencies() const { return currencyChanges; }
+    const std::vector<OverrideChange> &overrides() const { return overrideChanges; }
+
+    std::size_t size() const { return currencyChanges.size() + overrideChanges.size(); }
+    bool empty() const { return size() == 0; }
+};
+
+class ExchangeRateProvider {
+public:
+    virtual ~ExchangeRateProvider() = default;
+
+    // resolves a code to its interned id (kInvalidCurrencyId if unknown);
+    // callers on a hot path should do this once and keep the id
+    virtual CurrencyId findCurrency(const std::string &code) const = 0;
+
+    // multiplier for converting from -> to, or the reason there is none
+    virtual Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept = 0;
+
+    // convenience overload: resolves both codes, then takes the id path
+    Result<double> tryGetRate(const std::string &from, const std::string &to) const noexcept {
+        if (from == to) return 1.0;
+        return tryGetRate(findCurrency(from), findCurrency(to));
+    }
+
+    static constexpr std::uint64_t kUnversioned = ~std::uint64_t{0};
+
+    // Counter that changes whenever any rate may have changed, so callers can
+    // cache rates and revalidate cheaply. Read it before the rates it covers.
+    // Providers that do not track changes return kUnversioned.
+    virtual std::uint64_t getVersion() const noexcept { return kUnversioned; }
+
+    // digits after the decimal point in amounts of this currency (2 for USD, 0 for JPY)
+    virtual int getMinorUnits(CurrencyId id) const {
+        (void)id;
+        return 2;
+    }
+
+    // throwing wrappers, kept for existing callers
+    double getRate(CurrencyId from, CurrencyId to) const {
+        return tryGetRate(from, to).valueOrThrow();
+    }
+
+    double getRate(const std::string &from, const std::string &to) const {
+        return tryGetRate(from, to).valueOrThrow();
+    }
+
+    // allow overriding rates at runtime (default: not supported)
+    virtual void setCustomRate(const std::string &from, const std::string &to, double rate) {
+        (void)from; (void)to; (void)rate;
+        throw std::runtime_error("Custom rates not supported by this provider");
+    }
+
+    // applies every staged change as one new version (default: not supported)
+    virtual void applyUpdate(const RateUpdate &update) {
+        (void)update;
+        throw std::runtime_error("Bulk updates not supported by this provider");
+    }
+};
+
+// Minimal read-copy-update domain. Readers bracket their accesses with a
+// ReadGuard, which costs two uncontended atomic increments and never blocks.
+// A writer that has unpublished an object calls synchronize(); it returns once
+// every reader that could still be looking at the old object has left.
+class RcuDomain {
+    static constexpr std::size_t kSlots = 32;
+
+    // reader counts per phase parity, spread over cache lines to avoid contention
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> readers[2] = {};
+    };
+
+    Slot slots[kSlots];
+    std::atomic<std::uint64_t> phase{0};
+
+    static std::size_t threadSlot() {
+        static std::atomic<std::size_t> nextSlot{0};
+        thread_local std::size_t slot = nextSlot.fetch_add(1) % kSlots;
+        return slot;
+    }
+
+    std::uint64_t readersInParity(std::uint64_t parity) const {
+        std::uint64_t total = 0;
+        for (const Slot &slot : slots) {
+            total += slot.readers[parity].load();
+        }
+        return total;
+    }
+
+public:
+    class ReadGuard {
+        std::atomic<std::uint64_t> *counter;
+
+    public:
+        explicit ReadGuard(RcuDomain &domain)
+            : counter(&domain.slots[threadSlot()].readers[domain.phase.load() & 1]) {
+            counter->fetch_add(1);
+        }
+        ~ReadGuard() { counter->fetch_sub(1, std::memory_order_release); }
+
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+    };
+
+    // Waits out a full grace period. Two phase flips are needed: a reader may
+    // have sampled the phase just before the first flip and registered late.
+    void synchronize() {
+        for (int flip = 0; flip < 2; ++flip) {
+            std::uint64_t parity = phase.fetch_add(1) & 1;
+            while (readersInParity(parity) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+};
+
+// Immutable state of a StaticRateProvider at one point in time. Only the
+// provider edits a RateBook, and only a private copy before publishing it.
+class RateBook : public std::enable_shared_from_this<RateBook> {
+    friend class StaticRateProvider;
+
+    std::uint64_t generation = 0;                // bumped on every published change
+    CurrencyRegistry registry;
+    std::vector<double> baseRates;               // id -> rate vs base (0.0 = no base rate)
+    std::vector<std::uint8_t> minorUnits;        // id -> decimals in amounts
+    OverrideMap customRates;                     // pairKey(from, to) -> rate
+
+    bool matrixEnabled = false;                  // serve lookups from crossRates
+    CrossRateMatrix crossRates;                  // final rates, custom overrides applied
+
+    CurrencyId internCode(const std::string &code) {
+        CurrencyId id = registry.intern(code);
+        if (id >= baseRates.size()) {
+            baseRates.resize(id + 1, 0.0);
+            minorUnits.resize(id + 1, static_cast<std::uint8_t>(Iso4217::minorUnits(code)));
+            if (matrixEnabled) {
+                crossRates.resize(baseRates.size());
+                crossRates.at(id, id) = 1.0;  // a new code has no other rates yet
+            }
+        }
+        return id;
+    }
+
+    double baseRateOf(CurrencyId id) const {
+        return id < baseRates.size() ? baseRates[id] : 0.0;
+    }
+
+    // final rate from -> to, or 0.0 if there is none
+    double computeRate(CurrencyId from, CurrencyId to) const {
+        if (from == to && from != kInvalidCurrencyId) return 1.0;
+
+        // Check custom override first (skipped entirely when there are none)
+        if (!customRates.empty()) {
+            if (const double *custom = customRates.find(pairKey(from, to))) {
+                return *custom;
+            }
+        }
+
+        double rateFrom = baseRateOf(from); // from vs base
+        double rateTo   = baseRateOf(to);   // to vs base
+
+        if (rateFrom == 0.0 || rateTo == 0.0) {
+            return 0.0;
+        }
+
+        // Convert: from -> base -> to
+        return rateTo / rateFrom;
+    }
+
+    // recomputes the matrix row and column of one currency
+    void refreshCurrency(CurrencyId id) {
+        double *row = crossRates.writableRow(id);
+        for (CurrencyId other = 0; other < crossRates.size(); ++other) {
+            row[other] = computeRate(id, other);
+            crossRates.at(other, id) = computeRate(other, id);
+        }
+    }
+
+    void registerCurrency(const std::string &code, double rateVsBase, int decimals) {
+        CurrencyId id = internCode(code);
+        baseRates[id] = rateVsBase;
+        minorUnits[id] = static_cast<std::uint8_t>(decimals);
+        if (matrixEnabled) {
+            refreshCurrency(id);
+        }
+    }
+
+    void enableCrossRateMatrix() {
+        if (matrixEnabled) return;
+        matrixEnabled = true;
+        crossRates.resize(baseRates.size());
+        for (CurrencyId from = 0; from < crossRates.size(); ++from) {
+            for (CurrencyId to = 0; to < crossRates.size(); ++to) {
+                crossRates.at(from, to) = computeRate(from, to);
+            }
+        }
+    }
+
+    // A currency against itself is always 1.0 (computeRate answers that
+    // before looking at overrides), so self-pair overrides are dropped rather
+    // than written to the matrix diagonal, where only matrix mode would see them.
+    void setCustomRate(const std::string &from, const std::string &to, double rate) {
+        CurrencyId fromId = internCode(from);
+        CurrencyId toId   = internCode(to);
+        if (fromId == toId) return;
+        customRates.set(pairKey(fromId, toId), rate);
+        if (matrixEnabled) {
+            crossRates.at(fromId, toId) = rate;
+        }
+    }
+
+    // Applies a whole RateUpdate, then brings the matrix up to date once:
+    // the rows and columns of changed and new currencies, or a full rebuild
+    // when those would cover most of it anyway.
+    void apply(const RateUpdate &update) {
+        bool matrix = matrixEnabled;
+        matrixEnabled = false;  // no per-change upkeep below
+        std::size_t oldCount = baseRates.size();
+
+        std::vector<CurrencyId> touched;
+        for (const RateUpdate::CurrencyChange &change : update.currencies()) {
+            CurrencyId id = internCode(change.code);
+            baseRates[id]  = change.rateVsBase;
+            minorUnits[id] = static_cast<std::uint8_t>(change.minorUnits);
+            touched.push_back(id);
+        }
+        std::vector<std::uint64_t> overridden;
+        for (const RateUpdate::OverrideChange &change : update.overrides()) {
+            CurrencyId fromId = internCode(change.from);
+            CurrencyId toId   = internCode(change.to);
+            if (fromId == toId) continue;  // see setCustomRate
+            customRates.set(pairKey(fromId, toId), change.rate);
+            overridden.push_back(pairKey(fromId, toId));
+        }
+
+        matrixEnabled = matrix;
+        if (!matrixEnabled) return;
+
+        for (CurrencyId id = static_cast<CurrencyId>(oldCount); id < baseRates.size(); ++id) {
+            touched.push_back(id);
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+        crossRates.resize(baseRates.size());
+        if (touched.size() * 2 >= crossRates.size()) {
+            matrixEnabled = false;
+            enableCrossRateMatrix();  // refills every cell
+            return;
+        }
+        for (CurrencyId id : touched) {
+            refreshCurrency(id);
+        }
+        for (std::uint64_t key : overridden) {
+            CurrencyId fromId = static_cast<CurrencyId>(key >> 32);
+            CurrencyId toId   = static_cast<CurrencyId>(key);
+            crossRates.at(fromId, toId) = *customRates.find(key);
+        }
+    }
+
+public:
+    std::uint64_t getGeneration() const { return generation; }
+
+    CurrencyId findCurrency(const std::string &code) const {
+        return registry.find(code);
+    }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept {
+        double rate = 0.0;
+        if (!matrixEnabled) {
+            rate = computeRate(from, to);
+        } else if (from < crossRates.size() && to < crossRates.size()) {
+            rate = crossRates.at(from, to);
+        }
+
+        if (rate == 0.0) {
+            return ConversionError::UnsupportedCurrency;
+        }
+        return rate;
+    }
+
+    std::vector<std::string> getSupportedCodes() const {
+        std::vector<std::string> codes;
+        codes.reserve(baseRates.size());
+        for (CurrencyId id = 0; id < baseRates.size(); ++id) {
+            if (baseRates[id] != 0.0) {
+                codes.push_back(registry.getCode(id));
+            }
+        }
+        std::sort(codes.begin(), codes.end());
+        return codes;
+    }
+
+    std::size_t currencyCount() const { return registry.size(); }
+    std::string getCode(CurrencyId id) const { return registry.getCode(id); }
+    double getBaseRate(CurrencyId id) const { return baseRateOf(id); }
+    int getMinorUnits(CurrencyId id) const { return id < minorUnits.size() ? minorUnits[id] : 2; }
+    const OverrideMap &getCustomRates() const { return customRates; }
+
+    // final rates from one currency (0.0 = none), or nullptr without the matrix
+    const double *getCrossRow(CurrencyId from) const {
+        return matrixEnabled && from < crossRates.size() ? crossRates.row(from) : nullptr;
+    }
+};
+
+// Read-only view of a whole file. On POSIX systems the file is mmap'ed, so
+// opening costs no parsing and pages are loaded on first touch; elsewhere the
+// bytes are read into memory.
+class MappedFile {
+    const unsigned char *bytes = nullptr;
+    std::size_t length = 0;
+#ifndef CURRENCY_CONVERTER_POSIX
+    std::vector<unsigned char> storage;
+#endif
+
+public:
+    explicit MappedFile(const std::string &path) {
+#ifdef CURRENCY_CONVERTER_POSIX
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+        if (length > 0) {
+            void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Cannot map " + path);
+            }
+            bytes = static_cast<const unsigned char *>(mapped);
+        }
+        ::close(fd);  // the mapping stays valid
+#else
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        storage.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        bytes = storage.data();
+        length = storage.size();
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        if (bytes) ::munmap(const_cast<unsigned char *>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const unsigned char *data() const { return bytes; }
+    std::size_t size() const { return length; }
+};
+
+// Versioned, checksummed binary rate book:
+//
+//   Header | CurrencyRecord[currencyCount] | OverrideRecord[overrideCount]
+//
+// Currencies are stored in id order and overrides refer to them by index, so
+// loading needs no code lookups. Integers and doubles use the host byte order.
+class RateBookFile {
+public:
+    static constexpr char kMagic[4] = {'C', 'R', 'B', 'K'};
+    static constexpr std::uint32_t kVersion = 2;  // 2: adds minorUnits
+
+    struct Header {
+        char          magic[4];
+        std::uint32_t version;
+        std::uint32_t currencyCount;
+        std::uint32_t overrideCount;
+        char          baseCode[8];
+        std::uint64_t checksum;      // FNV-1a over every byte after the header
+    };
+
+    struct CurrencyRecord {
+        char   code[8];              // text fields are NUL-padded, not terminated
+        char   name[32];
+        char   symbol[8];
+        double rateVsBase;           // 0.0 = override-only code
+        std::uint8_t minorUnits;
+        std::uint8_t reserved[7];
+    };
+
+    struct OverrideRecord {
+        std::uint32_t from;          // index into the currency table
+        std::uint32_t to;
+        double        rate;
+    };
+
+    static_assert(sizeof(Header) == 32 && sizeof(CurrencyRecord) == 64 &&
+                  sizeof(OverrideRecord) == 16, "rate book records must be packed");
+
+    static std::uint64_t fnv1a(const unsigned char *p, std::size_t n) {
+        std::uint64_t hash = 1469598103934665603ull;
+        for (std::size_t i = 0; i < n; ++i) {
+            hash = (hash ^ p[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+private:
+    MappedFile file;
+    const Header *header;
+
+    static void putField(char *field, std::size_t width, const std::string &text) {
+        if (text.size() > width) {
+            throw std::runtime_error("Rate book field too long: " + text);
+        }
+        std::memset(field, 0, width);
+        std::memcpy(field, text.data(), text.size());
+    }
+
+public:
+    explicit RateBookFile(const std::string &path) : file(path) {
+        if (file.size() < sizeof(Header)) {
+            throw std::runtime_error("Not a rate book: " + path);
+        }
+        header = reinterpret_cast<const Header *>(file.data());
+        if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Not a rate book: " + path);
+        }
+        if (header->version != kVersion) {
+            throw std::runtime_error("Unsupported rate book version in " + path);
+        }
+
+        std::size_t expected = sizeof(Header) +
+                               header->currencyCount * sizeof(CurrencyRecord) +
+                               header->overrideCount * sizeof(OverrideRecord);
+        if (file.size() != expected ||
+            fnv1a(file.data() + sizeof(Header), file.size() - sizeof(Header)) != header->checksum) {
+            throw std::runtime_error("Corrupt rate book: " + path);
+        }
+
+        // same rules as RateUpdate: nothing a live update could not have set
+        for (std::size_t i = 0; i < header->currencyCount; ++i) {
+            const CurrencyRecord &record = currencies()[i];
+            if (!(record.rateVsBase >= 0.0) || !std::isfinite(record.rateVsBase) ||
+                record.minorUnits > AmountText::kMaxDecimals) {
+                throw std::runtime_error("Invalid rate for " + fieldText(record.code, sizeof(record.code)) +
+                                         " in rate book: " + path);
+            }
+        }
+        for (std::size_t i = 0; i < header->overrideCount; ++i) {
+            const OverrideRecord &record = overrides()[i];
+            if (record.from >= header->currencyCount || record.to >= header->currencyCount) {
+                throw std::runtime_error("Corrupt rate book: " + path);
+            }
+            if (!(record.rate > 0.0) || !std::isfinite(record.rate)) {
+                throw std::runtime_error("Invalid override rate in rate book: " + path);
+            }
+        }
+    }
+
+    static std::string fieldText(const char *field, std::size_t width) {
+        return std::string(field, strnlen(field, width));
+    }
+
+    std::string baseCode() const { return fieldText(header->baseCode, sizeof(header->baseCode)); }
+    std::size_t currencyCount() const { return header->currencyCount; }
+    std::size_t overrideCount() const { return header->overrideCount; }
+
+    const CurrencyRecord *currencies() const {
+        return reinterpret_cast<const CurrencyRecord *>(file.data() + sizeof(Header));
+    }
+
+    const OverrideRecord *overrides() const {
+        return reinterpret_cast<const OverrideRecord *>(
+            file.data() + sizeof(Header) + header->currencyCount * sizeof(CurrencyRecord));
+    }
+
+    // Writes book to path. Names and symbols come from metadata; codes
+    // without an entry get empty ones.
+    static void write(const std::string &path, const std::string &baseCode, const RateBook &book,
+                      const CurrencyTable &metadata) {
+        std::vector<unsigned char> bytes(sizeof(Header) +
+                                         book.currencyCount() * sizeof(CurrencyRecord) +
+                                         book.getCustomRates().size() * sizeof(OverrideRecord));
+
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof(kMagic));
+        h.version       = kVersion;
+        h.currencyCount = static_cast<std::uint32_t>(book.currencyCount());
+        h.overrideCount = static_cast<std::uint32_t>(book.getCustomRates().size());
+        putField(h.baseCode, sizeof(h.baseCode), baseCode);
+
+        unsigned char *cursor = bytes.data() + sizeof(Header);
+        for (CurrencyId id = 0; id < book.currencyCount(); ++id) {
+            CurrencyRecord record{};
+            const std::string &code = book.getCode(id);
+            putField(record.code, sizeof(record.code), code);
+            if (std::optional<Currency> meta = metadata.find(code)) {
+                putField(record.name, sizeof(record.name), meta->getName());
+                putField(record.symbol, sizeof(record.symbol), meta->getSymbol());
+            }
+            record.rateVsBase = book.getBaseRate(id);
+            record.minorUnits = static_cast<std::uint8_t>(book.getMinorUnits(id));
+            std::memcpy(cursor, &record, sizeof(record));
+            cursor += sizeof(record);
+        }
+
+        // sorted so the same book always produces the same bytes
+        std::vector<std::pair<std::uint64_t, double>> sorted = book.getCustomRates().entries();
+        std::sort(sorted.begin(), sorted.end());
+        for (const auto &entry : sorted) {
+            OverrideRecord record{static_cast<std::uint32_t>(entry.first >> 32),
+                                  static_cast<std::uint32_t>(entry.first), entry.second};
+            std::memcpy(cursor, &record, sizeof(record));
+            cursor += sizeof(record);
+        }
+
+        h.checksum = fnv1a(bytes.data() + sizeof(Header), bytes.size() - sizeof(Header));
+        std::memcpy(bytes.data(), &h, sizeof(h));
+
+        std::FILE *out = std::fopen(path.c_str(), "wb");
+        if (!out) {
+            throw std::runtime_error("Cannot create " + path);
+        }
+        bool written = std::fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+        written = std::fclose(out) == 0 && written;
+        if (!written) {
+            throw std::runtime_error("Cannot write " + path);
+        }
+    }
+};
+
+// Write-ahead log of rate changes, with periodic snapshots:
+//
+//   FileHeader | Frame* ;  Frame = FrameHeader | (EntryHeader | code bytes)*
+//
+// Each RateUpdate becomes one checksummed frame, so a crash mid-write loses
+// whole updates, never part of one. Appends are buffered; waitDurable()
+// writes and syncs everything pending at once, so writers that arrive while
+// a flush is running share the next one (group commit). A checkpoint saves
+// the current book as a rate book file next to the log ("<log>.snap") and
+// starts an empty log. Recovery maps the snapshot and replays only the log
+// written after it.
+class RateLog {
+public:
+    static constexpr char kMagic[4] = {'C', 'R', 'W', 'L'};
+    static constexpr std::uint32_t kVersion = 1;
+
+    struct FileHeader {
+        char          magic[4];
+        std::uint32_t version;
+        std::uint64_t firstSequence;  // of the first frame; earlier ones are in the snapshot
+    };
+
+    struct FrameHeader {
+        std::uint32_t length;         // bytes of entries after this header
+        std::uint32_t checksum;       // FNV-1a (low half) over sequence and entries
+        std::uint64_t sequence;       // 1, 2, 3, ... across checkpoints
+    };
+
+    enum EntryKind : std::uint8_t { kCurrencyEntry = 1, kOverrideEntry = 2 };
+
+    struct EntryHeader {
+        std::uint8_t  kind;
+        std::uint8_t  minorUnits;     // currency entries
+        std::uint8_t  fromLength;     // code bytes that follow: from, then to
+        std::uint8_t  toLength;       // override entries
+        std::uint32_t reserved;
+        double        rate;
+    };
+
+    static_assert(sizeof(FileHeader) == 16 && sizeof(FrameHeader) == 16 &&
+                  sizeof(EntryHeader) == 16, "rate log records must be packed");
+
+private:
+    std::string logPath;
+    std::string snapPath;
+    std::size_t checkpointInterval;   // frames between automatic checkpoints
+
+    std::mutex mutex;
+    std::condition_variable flushed;
+    std::vector<unsigned char> pending;  // encoded frames not yet written
+    std::uint64_t appended = 0;          // last sequence handed out
+    std::uint64_t durable = 0;           // last sequence on disk
+    std::uint64_t framesInLog = 0;
+    bool flushing = false;
+    std::uint64_t flushCount = 0;
+    std::string failure;                 // why a flush failed; the log refuses work after one
+#ifdef CURRENCY_CONVERTER_POSIX
+    int fd = -1;
+#else
+    std::FILE *file = nullptr;
+#endif
+
+    void openForAppend() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        fd = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) throw std::runtime_error("Cannot open " + logPath);
+#else
+        file = std::fopen(logPath.c_str(), "ab");
+        if (!file) throw std::runtime_error("Cannot open " + logPath);
+#endif
+    }
+
+    void closeFile() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#else
+        if (file) std::fclose(file);
+        file = nullptr;
+#endif
+    }
+
+    // caller holds mutex. A failed flush may leave part of a batch in the
+    // file, and recovery stops at the first bad frame: anything logged after
+    // it would be lost on restart, so nothing more is accepted.
+    void throwIfFailed() const {
+        if (!failure.empty()) throw std::runtime_error("Rate log unusable after an earlier error: " + failure);
+    }
+
+    // appends bytes to the open log and syncs them
+    void writeAndSync(const unsigned char *bytes, std::size_t count) {
+#ifdef CURRENCY_CONVERTER_POSIX
+        while (count > 0) {
+            ssize_t written = ::write(fd, bytes, count);
+            if (written < 0) throw std::runtime_error("Cannot write " + logPath);
+            bytes += written;
+            count -= static_cast<std::size_t>(written);
+        }
+        if (::fdatasync(fd) != 0) throw std::runtime_error("Cannot sync " + logPath);
+#else
+        if (std::fwrite(bytes, 1, count, file) != count || std::fflush(file) != 0) {
+            throw std::runtime_error("Cannot write " + logPath);
+        }
+#endif
+    }
+
+    static void syncPath(const std::string &path) {
+#ifdef CURRENCY_CONVERTER_POSIX
+        int handle = ::open(path.c_str(), O_RDONLY);
+        if (handle < 0) throw std::runtime_error("Cannot open " + path);
+        int status = ::fsync(handle);
+        ::close(handle);
+        if (status != 0) throw std::runtime_error("Cannot sync " + path);
+#else
+        (void)path;
+#endif
+    }
+
+    // atomically replaces target with the synced file at temp
+    static void replaceFile(const std::string &temp, const std::string &target) {
+        syncPath(temp);
+#ifndef CURRENCY_CONVERTER_POSIX
+        std::remove(target.c_str());
+#endif
+        if (std::rename(temp.c_str(), target.c_str()) != 0) {
+            throw std::runtime_error("Cannot replace " + target);
+        }
+#ifdef CURRENCY_CONVERTER_POSIX
+        std::size_t slash = target.find_last_of('/');
+        syncPath(slash == std::string::npos ? "." : target.substr(0, slash + 1));
+#endif
+    }
+
+    // writes a log holding only a header to path
+    static void writeEmptyLog(const std::string &path, std::uint64_t firstSequence) {
+        FileHeader header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.firstSequence = firstSequence;
+        std::FILE *out = std::fopen(path.c_str(), "wb");
+        if (!out) throw std::runtime_error("Cannot create " + path);
+        bool written = std::fwrite(&header, sizeof(header), 1, out) == 1;
+        written = std::fclose(out) == 0 && written;
+        if (!written) throw std::runtime_error("Cannot write " + path);
+    }
+
+    template <typename T>
+    void put(const T &value) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&value);
+        pending.insert(pending.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putCode(const std::string &code) {
+        pending.insert(pending.end(), code.begin(), code.end());
+    }
+
+    static std::uint8_t codeLength(const std::string &code) {
+        if (code.size() > 255) {
+            throw std::invalid_argument("Currency code too long for the rate log: " + code);
+        }
+        return static_cast<std::uint8_t>(code.size());
+    }
+
+    struct PairHash {
+        std::size_t operator()(const std::pair<std::string_view, std::string_view> &pair) const {
+            std::size_t h = std::hash<std::string_view>()(pair.first);
+            return h ^ (std::hash<std::string_view>()(pair.second) + 0x9E3779B97F4A7C15ull + (h << 6));
+        }
+    };
+
+public:
+    explicit RateLog(std::string path, std::size_t framesPerCheckpoint = 1000000)
+        : logPath(std::move(path)), snapPath(logPath + ".snap"),
+          checkpointInterval(framesPerCheckpoint) {}
+
+    ~RateLog() {
+        try {
+            if (appended > 0) waitDurable(appended);
+        } catch (const std::exception &) {
+            // nothing left to report to; the frames are lost like on a crash
+        }
+        closeFile();
+    }
+
+    RateLog(const RateLog &) = delete;
+    RateLog &operator=(const RateLog &) = delete;
+
+    bool hasSnapshot() const {
+        std::FILE *probe = std::fopen(snapPath.c_str(), "rb");
+        if (probe) std::fclose(probe);
+        return probe != nullptr;
+    }
+
+    const std::string &snapshotPath() const { return snapPath; }
+
+    // Reads the frames written after the snapshot, drops a torn or corrupt
+    // tail, and opens the log for appending. The frames come back merged
+    // into one update (the last change per currency or pair wins). Call once,
+    // before any append.
+    RateUpdate recover() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::FILE *probe = std::fopen(logPath.c_str(), "rb");
+        if (!probe) {
+            std::string temp = logPath + ".tmp";
+            writeEmptyLog(temp, 1);
+            replaceFile(temp, logPath);
+            openForAppend();
+            return RateUpdate();
+        }
+        std::fclose(probe);
+
+        struct CurrencyState { double rate; int minorUnits; };
+        std::unordered_map<std::string_view, CurrencyState> currencies;
+        std::unordered_map<std::pair<std::string_view, std::string_view>, double, PairHash> overrides;
+        std::vector<std::string_view> currencyOrder;
+        std::vector<std::pair<std::string_view, std::string_view>> overrideOrder;
+
+        MappedFile mapped(logPath);
+        const unsigned char *bytes = mapped.data();
+        std::size_t size = mapped.size();
+        FileHeader header{};
+        if (size < sizeof(header)) throw std::runtime_error("Not a rate log: " + logPath);
+        std::memcpy(&header, bytes, sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+            throw std::runtime_error("Not a rate log: " + logPath);
+        }
+        if (header.version != kVersion) {
+            throw std::runtime_error("Unsupported rate log version in " + logPath);
+        }
+
+        std::uint64_t next = header.firstSequence;
+        std::size_t pos = sizeof(header);
+        while (size - pos >= sizeof(FrameHeader)) {
+            FrameHeader frame;
+            std::memcpy(&frame, bytes + pos, sizeof(frame));
+            const unsigned char *body = bytes + pos + sizeof(frame);
+            if (frame.length > size - pos - sizeof(frame) || frame.sequence != next) break;
+            std::uint64_t checksum = RateBookFile::fnv1a(bytes + pos + 8, 8 + frame.length);
+            if (static_cast<std::uint32_t>(checksum) != frame.checksum) break;
+
+            // entries are trusted once the checksum matches, but still bounds-checked
+            std::size_t at = 0;
+            bool wellFormed = true;
+            while (at < frame.length) {
+                EntryHeader entry;
+                if (frame.length - at < sizeof(entry)) { wellFormed = false; break; }
+                std::memcpy(&entry, body + at, sizeof(entry));
+                at += sizeof(entry);
+                if (frame.length - at < std::size_t{entry.fromLength} + entry.toLength) {
+                    wellFormed = false;
+                    break;
+                }
+                std::string_view from(reinterpret_cast<const char *>(body + at), entry.fromLength);
+                std::string_view to(reinterpret_cast<const char *>(body + at) + entry.fromLength,
+                                    entry.toLength);
+                at += std::size_t{entry.fromLength} + entry.toLength;
+                if (entry.kind == kCurrencyEntry) {
+                    auto inserted = currencies.insert_or_assign(from, CurrencyState{entry.rate, entry.minorUnits});
+                    if (inserted.second) currencyOrder.push_back(from);
+                } else if (entry.kind == kOverrideEntry && entry.rate > 0.0) {
+                    auto inserted = overrides.insert_or_assign({from, to}, entry.rate);
+                    if (inserted.second) overrideOrder.emplace_back(from, to);
+                } else {
+                    wellFormed = false;
+                    break;
+                }
+            }
+            if (!wellFormed) break;
+            pos += sizeof(frame) + frame.length;
+            ++next;
+            ++framesInLog;
+        }
+
+        RateUpdate merged;
+        for (std::string_view code : currencyOrder) {
+            const CurrencyState &state = currencies.at(code);
+            merged.registerCurrency(std::string(code), state.rate, state.minorUnits);
+        }
+        for (const auto &pair : overrideOrder) {
+            merged.setCustomRate(std::string(pair.first), std::string(pair.second),
+                                 overrides.at(pair));
+        }
+
+        if (pos < size) {
+            // torn tail: keep the valid prefix only
+            std::string temp = logPath + ".tmp";
+            std::FILE *out = std::fopen(temp.c_str(), "wb");
+            if (!out) throw std::runtime_error("Cannot create " + temp);
+            bool written = std::fwrite(bytes, 1, pos, out) == pos;
+            written = std::fclose(out) == 0 && written;
+            if (!written) throw std::runtime_error("Cannot write " + temp);
+            replaceFile(temp, logPath);
+        }
+        appended = durable = next - 1;
+        openForAppend();
+        return merged;
+    }
+
+    // encodes update as the next frame; durable only after waitDurable
+    std::uint64_t append(const RateUpdate &update) {
+        std::lock_guard<std::mutex> lock(mutex);
+        throwIfFailed();
+        std::size_t start = pending.size();
+        try {
+            pending.resize(start + sizeof(FrameHeader));
+            for (const RateUpdate::CurrencyChange &change : update.currencies()) {
+                EntryHeader entry{kCurrencyEntry, static_cast<std::uint8_t>(change.minorUnits),
+                                  codeLength(change.code), 0, 0, change.rateVsBase};
+                put(entry);
+                putCode(change.code);
+            }
+            for (const RateUpdate::OverrideChange &change : update.overrides()) {
+                EntryHeader entry{kOverrideEntry, 0, codeLength(change.from),
+                                  codeLength(change.to), 0, change.rate};
+                put(entry);
+                putCode(change.from);
+                putCode(change.to);
+            }
+        } catch (...) {
+            pending.resize(start);
+            throw;
+        }
+
+        FrameHeader frame{static_cast<std::uint32_t>(pending.size() - start - sizeof(FrameHeader)),
+                          0, ++appended};
+        std::memcpy(pending.data() + start, &frame, sizeof(frame));
+        frame.checksum = static_cast<std::uint32_t>(
+            RateBookFile::fnv1a(pending.data() + start + 8, 8 + frame.length));
+        std::memcpy(pending.data() + start, &frame, sizeof(frame));
+        ++framesInLog;
+        return appended;
+    }
+
+    // Returns once frame sequence is on disk. The first waiter writes and
+    // syncs everything pending; waiters arriving meanwhile are covered by
+    // that flush or share the next one. If a flush fails, it and every later
+    // call throw.
+    void waitDurable(std::uint64_t sequence) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (durable < sequence) {
+            throwIfFailed();
+            if (flushing) {
+                flushed.wait(lock);
+                continue;
+            }
+            flushing = true;
+            std::vector<unsigned char> batch;
+            batch.swap(pending);
+            std::uint64_t target = appended;
+            lock.unlock();
+            try {
+                writeAndSync(batch.data(), batch.size());
+            } catch (const std::exception &ex) {
+                lock.lock();
+                failure = ex.what();
+                flushing = false;
+                flushed.notify_all();
+                throw;
+            }
+            lock.lock();
+            flushing = false;
+            durable = target;
+            ++flushCount;
+            flushed.notify_all();
+        }
+    }
+
+    bool checkpointDue() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return framesInLog >= checkpointInterval;
+    }
+
+    // Saves book, which must include every appended frame, as the snapshot
+    // and starts an empty log after it. Pending frames become durable with
+    // the snapshot.
+    void checkpoint(const RateBook &book, const std::string &baseCode) {
+        std::unique_lock<std::mutex> lock(mutex);
+        flushed.wait(lock, [this] { return !flushing; });
+        throwIfFailed();
+
+        std::string temp = snapPath + ".tmp";
+        RateBookFile::write(temp, baseCode, book, {});
+        replaceFile(temp, snapPath);
+
+        // a crash before the log is replaced replays frames the snapshot
+        // already holds; the last change per key wins either way
+        temp = logPath + ".tmp";
+        writeEmptyLog(temp, appended + 1);
+        replaceFile(temp, logPath);
+        closeFile();
+        openForAppend();
+
+        pending.clear();
+        durable = appended;
+        framesInLog = 0;
+        flushed.notify_all();
+    }
+
+    // syncs so far; fewer than appended frames when writers shared them
+    std::uint64_t getFlushCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return flushCount;
+    }
+};
+
+#ifdef CURRENCY_CONVERTER_POSIX
+
+// Rate book in a POSIX shared-memory segment, so every process on a host
+// converts from one copy:
+//
+//   Header | codes | baseRates | minorUnits | codeIndex | overrideKeys | overrideRates | crossRates
+//
+// One writer process mirrors its StaticRateProvider into the segment, and
+// readers map it and look rates up in place. Updates go through a seqlock:
+// the writer makes the sequence odd, stores only the words that changed and
+// makes it even again. A reader retries if the sequence was odd or moved
+// while it read. Every shared word is a lock-free std::atomic (doubles as
+// their bit patterns); those are address-free, so this is well-defined
+// across processes. Zero-filled memory reads as an empty book.
+class SharedRateBook {
+public:
+    static constexpr char kMagic[4] = {'C', 'R', 'S', 'M'};
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kMaxMatrixCapacity = 4096;  // larger books compute rates
+
+    using Word = std::atomic<std::uint64_t>;
+    static_assert(Word::is_always_lock_free, "shared rate book needs lock-free 64-bit atomics");
+
+    struct Geometry {
+        char          magic[4];
+        std::uint32_t version;
+        std::uint32_t capacity;        // currencies
+        std::uint32_t indexSlots;      // code -> id hash table, a power of two
+        std::uint32_t overrideSlots;   // override hash table, a power of two
+        std::uint32_t matrixDim;       // capacity, or 0 without a cross-rate table
+    };
+
+    struct Header {
+        Geometry geometry;             // fixed when the segment is created
+        alignas(64) Word sequence;     // odd while the writer is mid-update
+        Word generation;               // of the mirrored RateBook
+        Word currencyCount;
+        Word baseCode;                 // packed like codes[]
+    };
+
+private:
+    std::string segmentName;
+    bool writable;
+    bool mirrored = false;          // holds the last book this writer published
+    std::uint64_t generationBase = 0;  // added to book generations; past an earlier writer's
+    unsigned char *bytes = nullptr;
+    std::size_t length = 0;
+
+    Header *header = nullptr;
+    Word *codes = nullptr;          // id -> code, up to 8 bytes packed; 0 = none
+    Word *baseRates = nullptr;      // id -> rate vs base; 0.0 = no base rate
+    Word *minorUnits = nullptr;
+    Word *codeIndex = nullptr;      // id + 1; 0 = empty slot
+    Word *overrideKeys = nullptr;   // pairKey + 1; 0 = empty slot
+    Word *overrideRates = nullptr;
+    Word *crossRates = nullptr;     // [from * matrixDim + to], overrides applied
+
+    struct Layout {
+        std::size_t codes, baseRates, minorUnits, codeIndex, overrideKeys, overrideRates,
+                    crossRates, total;
+    };
+
+    static std::size_t roundUp(std::size_t n, std::size_t to) { return (n + to - 1) / to * to; }
+
+    static std::size_t powerOfTwoAtLeast(std::size_t n) {
+        std::size_t p = 1;
+        while (p < n) p *= 2;
+        return p;
+    }
+
+    static Layout layoutOf(const Geometry &g) {
+        Layout layout;
+        std::size_t at = roundUp(sizeof(Header), 64);
+        auto take = [&at](std::size_t words) {
+            std::size_t start = at;
+            at = roundUp(at + words * sizeof(Word), 64);
+            return start;
+        };
+        layout.codes         = take(g.capacity);
+        layout.baseRates     = take(g.capacity);
+        layout.minorUnits    = take(g.capacity);
+        layout.codeIndex     = take(g.indexSlots);
+        layout.overrideKeys  = take(g.overrideSlots);
+        layout.overrideRates = take(g.overrideSlots);
+        layout.crossRates    = take(std::size_t{g.matrixDim} * g.matrixDim);
+        layout.total         = at;
+        return layout;
+    }
+
+    const Geometry &geometry() const { return header->geometry; }
+
+    void map(int fd, std::size_t size) {
+        int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        void *mapped = ::mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Cannot map shared rate book " + segmentName);
+        }
+        bytes  = static_cast<unsigned char *>(mapped);
+        length = size;
+        header = reinterpret_cast<Header *>(bytes);
+    }
+
+    void bindArrays() {
+        Layout layout = layoutOf(header->geometry);
+        auto words = [this](std::size_t offset) { return reinterpret_cast<Word *>(bytes + offset); };
+        codes         = words(layout.codes);
+        baseRates     = words(layout.baseRates);
+        minorUnits    = words(layout.minorUnits);
+        codeIndex     = words(layout.codeIndex);
+        overrideKeys  = words(layout.overrideKeys);
+        overrideRates = words(layout.overrideRates);
+        crossRates    = words(layout.crossRates);
+    }
+
+    static std::uint64_t bitsOf(double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    static double doubleOf(std::uint64_t bits) {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // false if the code does not fit in one word
+    static bool packCode(const std::string &code, std::uint64_t &packed) {
+        if (code.empty() || code.size() > sizeof(packed)) return false;
+        packed = 0;
+        std::memcpy(&packed, code.data(), code.size());
+        return true;
+    }
+
+    static std::size_t slotOf(std::uint64_t key, std::size_t slots) {
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 40) & (slots - 1);
+    }
+
+    static std::uint64_t load(const Word &word) { return word.load(std::memory_order_relaxed); }
+
+    // Runs read until it completes without overlapping an update. Reads
+    // inside must be relaxed loads, and indices taken from shared words must
+    // be bounds-checked: a read racing an update sees a mix of both states.
+    template <typename Read>
+    auto consistent(Read read) const -> decltype(read()) {
+        while (true) {
+            std::uint64_t before = header->sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0) {
+                auto value = read();
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (header->sequence.load(std::memory_order_relaxed) == before) return value;
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    CurrencyId findUnlocked(std::uint64_t packed) const {
+        std::size_t slots = geometry().indexSlots;
+        std::size_t slot  = slotOf(packed, slots);
+        for (std::size_t probe = 0; probe < slots; ++probe, slot = (slot + 1) & (slots - 1)) {
+            std::uint64_t entry = load(codeIndex[slot]);
+            if (entry == 0) break;
+            if (entry - 1 < geometry().capacity && load(codes[entry - 1]) == packed) {
+                return static_cast<CurrencyId>(entry - 1);
+            }
+        }
+        return kInvalidCurrencyId;
+    }
+
+    // same rule as RateBook::computeRate
+    double computeUnlocked(CurrencyId from, CurrencyId to) const {
+        std::uint64_t count = load(header->currencyCount);
+        if (from >= count || to >= count || count > geometry().capacity) return 0.0;
+        if (geometry().matrixDim != 0) {
+            return doubleOf(load(crossRates[std::size_t{from} * geometry().matrixDim + to]));
+        }
+        if (from == to) return 1.0;
+
+        std::uint64_t key   = pairKey(from, to) + 1;
+        std::size_t slots = geometry().overrideSlots;
+        std::size_t slot  = slotOf(key, slots);
+        for (std::size_t probe = 0; probe < slots; ++probe, slot = (slot + 1) & (slots - 1)) {
+            std::uint64_t stored = load(overrideKeys[slot]);
+            if (stored == 0) break;
+            if (stored == key) return doubleOf(load(overrideRates[slot]));
+        }
+
+        double rateFrom = doubleOf(load(baseRates[from]));
+        double rateTo   = doubleOf(load(baseRates[to]));
+        if (rateFrom == 0.0 || rateTo == 0.0) return 0.0;
+        return rateTo / rateFrom;
+    }
+
+    // Free slot for key in an open-addressing table image being built.
+    // Callers insert in key order, so the same set always lands in the same
+    // slots and a publish rewrites few of them.
+    static std::size_t claimSlot(const std::vector<std::uint64_t> &image, std::uint64_t key) {
+        std::size_t slots = image.size();
+        std::size_t slot  = slotOf(key, slots);
+        while (image[slot] != 0) slot = (slot + 1) & (slots - 1);
+        return slot;
+    }
+
+public:
+    // Creates (or takes over) the segment as its writer, sized for capacity
+    // currencies and overrideCapacity overrides. A segment left by an earlier
+    // writer with the same sizes is reused, so attached readers keep working;
+    // otherwise it is replaced and readers must reopen it. On reuse the
+    // published generation carries on from the earlier writer's, and if that
+    // writer died mid-update (odd sequence) readers keep waiting until this
+    // one's first publish completes.
+    SharedRateBook(const std::string &name, std::size_t capacity, std::size_t overrideCapacity)
+        : segmentName(name), writable(true) {
+        if (capacity == 0 || capacity > std::numeric_limits<std::uint32_t>::max() / 2) {
+            throw std::invalid_argument("Shared rate book capacity out of range");
+        }
+        Geometry wanted{};
+        std::memcpy(wanted.magic, kMagic, sizeof(kMagic));
+        wanted.version       = kVersion;
+        wanted.capacity      = static_cast<std::uint32_t>(capacity);
+        wanted.indexSlots    = static_cast<std::uint32_t>(powerOfTwoAtLeast(capacity * 2));
+        wanted.overrideSlots = static_cast<std::uint32_t>(powerOfTwoAtLeast(overrideCapacity * 2 + 1));
+        wanted.matrixDim     = capacity <= kMaxMatrixCapacity ? wanted.capacity : 0;
+        std::size_t size = layoutOf(wanted).total;
+
+        int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) throw std::runtime_error("Cannot open shared rate book " + name);
+        struct stat info;
+        bool reuse = ::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) == size;
+        if (reuse) {
+            map(fd, size);
+            reuse = std::memcmp(&geometry(), &wanted, sizeof(wanted)) == 0;
+            if (!reuse) {
+                ::munmap(bytes, length);
+                bytes = nullptr;
+            }
+        }
+        if (!reuse) {
+            // a fresh segment, so readers of the old one never see it resized
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+            if (fd < 0 || ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                if (fd >= 0) ::close(fd);
+                throw std::runtime_error("Cannot create shared rate book " + name);
+            }
+            map(fd, size);
+            header->geometry = wanted;
+        }
+        ::close(fd);  // the mapping stays valid
+        bindArrays();
+        if (reuse) generationBase = load(header->generation) + 1;
+    }
+
+    // Opens an existing segment as a reader.
+    explicit SharedRateBook(const std::string &name) : segmentName(name), writable(false) {
+        int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) throw std::runtime_error("Cannot open shared rate book " + name);
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Not a shared rate book: " + name);
+        }
+        map(fd, static_cast<std::size_t>(info.st_size));
+        ::close(fd);
+        if (std::memcmp(geometry().magic, kMagic, sizeof(kMagic)) != 0 ||
+            geometry().version != kVersion || layoutOf(geometry()).total != length) {
+            ::munmap(bytes, length);
+            throw std::runtime_error("Not a shared rate book: " + name);
+        }
+        bindArrays();
+    }
+
+    ~SharedRateBook() {
+        if (bytes) ::munmap(bytes, length);
+    }
+
+    SharedRateBook(const SharedRateBook &) = delete;
+    SharedRateBook &operator=(const SharedRateBook &) = delete;
+
+    // deletes the segment name; processes that have it mapped keep their copy
+    static void remove(const std::string &name) { ::shm_unlink(name.c_str()); }
+
+    // The words one publish stores, worked out by stage() and stored by
+    // store(). Every check and allocation happens in stage().
+    struct Staged {
+        std::vector<std::pair<Word *, std::uint64_t>> changes;
+        std::uint64_t currencyCount = 0;
+        std::uint64_t generation = 0;
+        bool ready = false;
+    };
+
+    // Works out what makes the segment match book, while readers carry on;
+    // throws if book does not fit (too many currencies or overrides, or a
+    // code longer than 8 bytes). If book is the last published one plus
+    // applied, only the cross rates applied can have changed are compared.
+    // Writer only.
+    Staged stage(const RateBook &book, const std::string &baseCode,
+                 const RateUpdate *applied = nullptr) const {
+        if (!writable) throw std::runtime_error("Shared rate book is read-only");
+        std::size_t count = book.currencyCount();
+        if (count > geometry().capacity) throw std::runtime_error("Shared rate book is full");
+        if (book.getCustomRates().size() * 2 >= geometry().overrideSlots) {
+            throw std::runtime_error("Shared rate book has no room for more overrides");
+        }
+
+        Staged staged;
+        std::vector<std::pair<Word *, std::uint64_t>> &changes = staged.changes;
+        auto stage = [&changes](Word &word, std::uint64_t value) {
+            if (load(word) != value) changes.emplace_back(&word, value);
+        };
+
+        std::uint64_t packedBase = 0;
+        packCode(baseCode, packedBase);
+        stage(header->baseCode, packedBase);
+
+        std::size_t oldCount = std::min<std::size_t>(load(header->currencyCount), geometry().capacity);
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> entries;  // code -> id + 1
+        for (std::size_t id = 0; id < std::max(count, oldCount); ++id) {
+            std::uint64_t packed = 0;
+            if (id < count && !packCode(book.getCode(static_cast<CurrencyId>(id)), packed)) {
+                throw std::runtime_error("Currency code too long for a shared rate book: " +
+                                         book.getCode(static_cast<CurrencyId>(id)));
+            }
+            CurrencyId cid = static_cast<CurrencyId>(id);
+            stage(codes[id], packed);
+            stage(baseRates[id], id < count ? bitsOf(book.getBaseRate(cid)) : 0);
+            stage(minorUnits[id], id < count ? static_cast<std::uint64_t>(book.getMinorUnits(cid)) : 0);
+            if (id < count) entries.emplace_back(packed, id + 1);
+        }
+
+        std::vector<std::uint64_t> indexImage(geometry().indexSlots);
+        std::sort(entries.begin(), entries.end());
+        for (const auto &entry : entries) {
+            indexImage[claimSlot(indexImage, entry.first)] = entry.second;
+        }
+        for (std::size_t slot = 0; slot < indexImage.size(); ++slot) {
+            stage(codeIndex[slot], indexImage[slot]);
+        }
+
+        std::vector<std::uint64_t> keyImage(geometry().overrideSlots), rateImage(geometry().overrideSlots);
+        std::vector<std::pair<std::uint64_t, double>> overrides = book.getCustomRates().entries();
+        std::sort(overrides.begin(), overrides.end());
+        for (const auto &entry : overrides) {
+            std::size_t slot = claimSlot(keyImage, entry.first + 1);
+            keyImage[slot]  = entry.first + 1;
+            rateImage[slot] = bitsOf(entry.second);
+        }
+        for (std::size_t slot = 0; slot < keyImage.size(); ++slot) {
+            stage(overrideKeys[slot], keyImage[slot]);
+            stage(overrideRates[slot], rateImage[slot]);
+        }
+
+        std::size_t dim = geometry().matrixDim;
+        auto stageCell = [&](CurrencyId from, CurrencyId to) {
+            double rate = 0.0;
+            if (const double *row = book.getCrossRow(from)) {
+                rate = row[to];
+            } else if (Result<double> computed = book.tryGetRate(from, to)) {
+                rate = computed.value();
+            }
+            stage(crossRates[std::size_t{from} * dim + to], bitsOf(rate));
+        };
+        bool incremental = applied && mirrored &&
+                           load(header->generation) + 1 == generationBase + book.getGeneration();
+        if (dim != 0 && incremental) {
+            std::vector<CurrencyId> touched;
+            for (const RateUpdate::CurrencyChange &change : applied->currencies()) {
+                touched.push_back(book.findCurrency(change.code));
+            }
+            for (std::size_t id = oldCount; id < count; ++id) {
+                touched.push_back(static_cast<CurrencyId>(id));
+            }
+            for (CurrencyId id : touched) {
+                for (CurrencyId other = 0; other < count; ++other) {
+                    stageCell(id, other);
+                    stageCell(other, id);
+                }
+            }
+            for (const RateUpdate::OverrideChange &change : applied->overrides()) {
+                stageCell(book.findCurrency(change.from), book.findCurrency(change.to));
+            }
+        } else if (dim != 0) {
+            for (CurrencyId from = 0; from < count; ++from) {
+                for (CurrencyId to = 0; to < count; ++to) stageCell(from, to);
+            }
+        }
+
+        staged.currencyCount = count;
+        staged.generation    = generationBase + book.getGeneration();
+        staged.ready         = true;
+        return staged;
+    }
+
+    // Stores what stage() worked out; readers wait only for this. Writer only.
+    void store(const Staged &staged) noexcept {
+        if (!staged.ready) return;
+        // odd already if an earlier writer stopped mid-update: finish its update
+        std::uint64_t sequence = load(header->sequence) | 1;
+        header->sequence.store(sequence, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (const auto &change : staged.changes) {
+            change.first->store(change.second, std::memory_order_relaxed);
+        }
+        header->currencyCount.store(staged.currencyCount, std::memory_order_relaxed);
+        header->generation.store(staged.generation, std::memory_order_relaxed);
+        header->sequence.store(sequence + 1, std::memory_order_release);
+        mirrored = true;
+    }
+
+    // Makes the segment match book (see stage). Writer only.
+    void publish(const RateBook &book, const std::string &baseCode,
+                 const RateUpdate *applied = nullptr) {
+        store(stage(book, baseCode, applied));
+    }
+
+    std::uint64_t getGeneration() const {
+        return consistent([this] { return load(header->generation); });
+    }
+
+    std::string getBaseCode() const {
+        std::uint64_t packed = consistent([this] { return load(header->baseCode); });
+        char text[sizeof(packed)];
+        std::memcpy(text, &packed, sizeof(packed));
+        return std::string(text, strnlen(text, sizeof(text)));
+    }
+
+    CurrencyId findCurrency(const std::string &code) const {
+        std::uint64_t packed;
+        if (!packCode(code, packed)) return kInvalidCurrencyId;
+        return consistent([&] { return findUnlocked(packed); });
+    }
+
+    // final rate from -> to, or 0.0 if there is none
+    double rateOf(CurrencyId from, CurrencyId to) const noexcept {
+        return consistent([&] { return computeUnlocked(from, to); });
+    }
+
+    int getMinorUnits(CurrencyId id) const {
+        return static_cast<int>(consistent([&]() -> std::uint64_t {
+            return id < std::min<std::uint64_t>(load(header->currencyCount), geometry().capacity)
+                       ? load(minorUnits[id]) : 2;
+        }));
+    }
+
+    std::vector<std::string> getSupportedCodes() const {
+        std::vector<std::string> result = consistent([this] {
+            std::vector<std::string> found;
+            std::size_t count = std::min<std::uint64_t>(load(header->currencyCount), geometry().capacity);
+            for (std::size_t id = 0; id < count; ++id) {
+                if (load(baseRates[id]) == 0) continue;
+                std::uint64_t packed = load(codes[id]);
+                char text[sizeof(packed)];
+                std::memcpy(text, &packed, sizeof(packed));
+                found.emplace_back(text, strnlen(text, sizeof(text)));
+            }
+            return found;
+        });
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    std::size_t segmentBytes() const { return length; }
+};
+
+// Read-only provider over a SharedRateBook segment: lookups read the mapped
+// memory directly, with no copy of the book in this process. The version is
+// the writer's book generation, so QuoteCache and BatchReport work as usual.
+class SharedRateProvider final : public ExchangeRateProvider {
+    SharedRateBook book;
+
+public:
+    explicit SharedRateProvider(const std::string &name) : book(name) {}
+
+    using ExchangeRateProvider::tryGetRate;
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        return book.findCurrency(code);
+    }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        double rate = book.rateOf(from, to);
+        if (rate == 0.0) return ConversionError::UnsupportedCurrency;
+        return rate;
+    }
+
+    std::uint64_t getVersion() const noexcept override { return book.getGeneration(); }
+    int getMinorUnits(CurrencyId id) const override { return book.getMinorUnits(id); }
+    std::vector<std::string> getSupportedCodes() const { return book.getSupportedCodes(); }
+    std::string getBaseCode() const { return book.getBaseCode(); }
+};
+
+#endif  // CURRENCY_CONVERTER_POSIX
+
+// A pinned RateBook behind the provider interface. Every lookup sees the same
+// book, whatever writers publish meanwhile, and costs no synchronisation: the
+// book is immutable and this object keeps it alive. getVersion() names the
+// book (its generation), so results can be traced to the rates they used.
+class RateSnapshot final : public ExchangeRateProvider {
+    std::shared_ptr<const RateBook> book;
+
+public:
+    explicit RateSnapshot(std::shared_ptr<const RateBook> pinned) : book(std::move(pinned)) {}
+
+    using ExchangeRateProvider::tryGetRate;
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        return book->findCurrency(code);
+    }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        return book->tryGetRate(from, to);
+    }
+
+    int getMinorUnits(CurrencyId id) const override { return book->getMinorUnits(id); }
+
+    std::uint64_t getVersion() const noexcept override { return book->getGeneration(); }
+
+    const RateBook &getBook() const { return *book; }
+};
+
+// A built-in rate against the base currency. Its decimals are looked up in
+// the ISO 4217 table while compiling.
+struct SeedRate {
+    const char *code;
+    double rateVsBase;
+    int minorUnits;
+
+    constexpr SeedRate(const char *c, double rate)
+        : code(c), rateVsBase(rate), minorUnits(Iso4217::minorUnits(c)) {}
+};
+
+// Serves rates from the current RateBook, published through an atomic pointer.
+// Readers are wait-free and may run on any number of threads. Mutations are
+// serialised: each copies the current book, edits the copy, publishes it, and
+// frees the old book once no reader can still be using it.
+class StaticRateProvider final : public ExchangeRateProvider {
+    std::string baseCurrencyCode;                // all rates are stored relative to this base
+
+    std::atomic<const RateBook *> current{nullptr};
+    std::atomic<std::uint64_t> version{0};       // generation of *current, stored after it
+    std::shared_ptr<RateBook> currentOwner;      // keeps *current alive
+    mutable RcuDomain rcu;
+    std::mutex writerMutex;
+
+    RateLog *log = nullptr;                      // write-ahead log, if attached
+#ifdef CURRENCY_CONVERTER_POSIX
+    SharedRateBook *shared = nullptr;            // mirrored on every publish, if attached
+    using Mirror = SharedRateBook::Staged;
+#else
+    struct Mirror {};
+#endif
+
+    // caller holds writerMutex; what the shared segment (if any) needs to
+    // match book. Throws if the segment cannot hold it.
+    Mirror mirrorOf(const RateBook &book, const std::string &baseCode,
+                    const RateUpdate *applied = nullptr) const {
+#ifdef CURRENCY_CONVERTER_POSIX
+        if (shared) return shared->stage(book, baseCode, applied);
+#endif
+        (void)book; (void)baseCode; (void)applied;
+        return Mirror();
+    }
+
+    void update(const std::function<void(RateBook &)> &mutate) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        std::shared_ptr<RateBook> next = prepare(mutate);
+        Mirror mirror = mirrorOf(*next, baseCurrencyCode);
+        publish(std::move(next), mirror);
+    }
+
+    // caller holds writerMutex; the next version, not yet published
+    std::shared_ptr<RateBook> prepare(const std::function<void(RateBook &)> &mutate) const {
+        auto next = currentOwner ? std::make_shared<RateBook>(*currentOwner)
+                                 : std::make_shared<RateBook>();
+        mutate(*next);
+        next->generation = currentOwner ? currentOwner->generation + 1 : 0;
+        return next;
+    }
+
+    // Applies changes as one new version: built and checked against the
+    // shared segment first, then logged (if a log is attached), then
+    // published, so a failure before publishing leaves the log, the book and
+    // the segment as they were. The call returns once the change is on disk;
+    // readers see it slightly earlier, while the flush is in flight.
+    void commit(const RateUpdate &changes) {
+        std::uint64_t sequence = 0;
+        {
+            std::lock_guard<std::mutex> lock(writerMutex);
+            std::shared_ptr<RateBook> next = prepare([&](RateBook &book) { book.apply(changes); });
+            Mirror mirror = mirrorOf(*next, baseCurrencyCode, &changes);
+            if (log) sequence = log->append(changes);
+            publish(std::move(next), mirror);
+            if (log && log->checkpointDue()) {
+                log->checkpoint(*currentOwner, baseCurrencyCode);
+            }
+        }
+        if (log) log->waitDurable(sequence);
+    }
+
+    // caller holds writerMutex. Nothing here throws: once readers can see
+    // next, the old book must outlive the grace period.
+    void publish(std::shared_ptr<RateBook> next, const Mirror &mirror) noexcept {
+        current.store(next.get());
+        version.store(next->generation);
+        std::shared_ptr<RateBook> retired = std::move(currentOwner);
+        currentOwner = std::move(next);
+#ifdef CURRENCY_CONVERTER_POSIX
+        if (shared) shared->store(mirror);
+#else
+        (void)mirror;
+#endif
+        rcu.synchronize();
+        // retired is released here, after the grace period
+    }
+
+    // Hard-coded demo rates, for example only
+    static constexpr SeedRate kSeedRates[] = {
+        {"EUR", 0.92},    // 1 USD ≈ 0.92 EUR
+        {"INR", 83.10},   // 1 USD ≈ 83.10 INR
+        {"GBP", 0.79},    // 1 USD ≈ 0.79 GBP
+        {"JPY", 141.50},  // 1 USD ≈ 141.50 JPY
+        {"AUD", 1.47},    // 1 USD ≈ 1.47 AUD
+        {"CAD", 1.34},    // 1 USD ≈ 1.34 CAD
+    };
+
+public:
+    explicit StaticRateProvider(std::string baseCode = "USD")
+        : baseCurrencyCode(std::move(baseCode)) {
+        update([this](RateBook &book) {
+            book.registerCurrency(baseCurrencyCode, 1.0, Iso4217::minorUnits(baseCurrencyCode));  // base
+            for (const SeedRate &seed : kSeedRates) {
+                book.registerCurrency(seed.code, seed.rateVsBase, seed.minorUnits);
+            }
+        });
+    }
+
+    using ExchangeRateProvider::tryGetRate;
+
+    void registerCurrency(const std::string &code, double rateVsBase, int minorUnits = 2) {
+        commit(RateUpdate().registerCurrency(code, rateVsBase, minorUnits));
+    }
+
+    // Restores the state kept in wal (its snapshot, then the log tail as one
+    // update), then logs every later change to it. Call before the provider
+    // is shared with other threads.
+    void attachLog(RateLog &wal) {
+        if (wal.hasSnapshot()) {
+            loadRateBook(RateBookFile(wal.snapshotPath()));
+        }
+        applyUpdate(wal.recover());
+        std::lock_guard<std::mutex> lock(writerMutex);
+        log = &wal;
+    }
+
+#ifdef CURRENCY_CONVERTER_POSIX
+    // Mirrors the book into segment now and after every later change, for
+    // SharedRateProvider readers in other processes.
+    void shareTo(SharedRateBook &segment) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+        segment.publish(*currentOwner, baseCurrencyCode);
+        shared = &segment;
+    }
+#endif
+
+    // Replaces every currency and override with the contents of a rate book
+    // file. Arrays are sized once and filled in id order; the lookup mode
+    // (computed or matrix) is kept.
+    void loadRateBook(const RateBookFile &file) {
+        std::lock_guard<std::mutex> lock(writerMutex);
+
+        auto next = std::make_shared<RateBook>();
+        const RateBookFile::CurrencyRecord *records = file.currencies();
+        next->baseRates.resize(file.currencyCount());
+        next->minorUnits.resize(file.currencyCount());
+        for (std::size_t i = 0; i < file.currencyCount(); ++i) {
+            std::string code = RateBookFile::fieldText(records[i].code, sizeof(records[i].code));
+            if (next->registry.intern(code) != i) {
+                throw std::runtime_error("Duplicate currency in rate book: " + code);
+            }
+            next->baseRates[i]  = records[i].rateVsBase;
+            next->minorUnits[i] = records[i].minorUnits;
+        }
+
+        const RateBookFile::OverrideRecord *overrides = file.overrides();
+        for (std::size_t i = 0; i < file.overrideCount(); ++i) {
+            if (overrides[i].from == overrides[i].to) continue;
+            next->customRates.set(pairKey(overrides[i].from, overrides[i].to), overrides[i].rate);
+        }
+
+        if (currentOwner->matrixEnabled) {
+            next->enableCrossRateMatrix();
+        }
+        next->generation = currentOwner->generation + 1;
+        Mirror mirror = mirrorOf(*next, file.baseCode());
+        baseCurrencyCode = file.baseCode();
+        publish(std::move(next), mirror);
+        if (log) {
+            log->checkpoint(*currentOwner, baseCurrencyCode);  // the log can't express a reload
+        }
+    }
+
+    void writeRateBook(const std::string &path, const CurrencyTable &metadata) const {
+        RateBookFile::write(path, baseCurrencyCode, *snapshot(), metadata);
+    }
+
+    // pins the current book; it stays valid and unchanged while the caller holds it
+    std::shared_ptr<const RateBook> snapshot() const {
+        RcuDomain::ReadGuard guard(rcu);
+        return current.load()->shared_from_this();
+    }
+
+    // the current book as a provider, for running a batch against one version
+    RateSnapshot pin() const { return RateSnapshot(snapshot()); }
+
+    // Switches lookups to a precomputed N x N cross-rate matrix. Later calls to
+    // registerCurrency/setCustomRate refresh only the entries they affect.
+    void enableCrossRateMatrix() {
+        update([](RateBook &book) { book.enableCrossRateMatrix(); });
+    }
+
+    std::vector<std::string> getSupportedCodes() const {
+        RcuDomain::ReadGuard guard(rcu);
+        return current.load()->getSupportedCodes();
+    }
+
+    std::uint64_t getVersion() const noexcept override { return version.load(); }
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        RcuDomain::ReadGuard guard(rcu);
+        return current.load()->findCurrency(code);
+    }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        RcuDomain::ReadGuard guard(rcu);
+        return current.load()->tryGetRate(from, to);
+    }
+
+    int getMinorUnits(CurrencyId id) const override {
+        RcuDomain::ReadGuard guard(rcu);
+        return current.load()->getMinorUnits(id);
+    }
+
+    void setCustomRate(const std::string &from, const std::string &to, double rate) override {
+        commit(RateUpdate().setCustomRate(from, to, rate));
+    }
+
+    // one book copy and one publish (so one version) for the whole update
+    void applyUpdate(const RateUpdate &changes) override {
+        if (changes.empty()) return;
+        commit(changes);
+    }
+};
+
+// Directed graph of custom-override edges, indexed by currency id.
+class RateGraph {
+public:
+    struct Edge {
+        CurrencyId to;
+        double rate;
+    };
+
+private:
+    std::vector<std::vector<Edge>> outgoing;        // edges by source id
+    std::vector<std::vector<CurrencyId>> incoming;  // edge sources by target id
+    std::size_t edges = 0;
+
+    static const std::vector<Edge> &noEdges() {
+        static const std::vector<Edge> empty;
+        return empty;
+    }
+
+    static const std::vector<CurrencyId> &noSources() {
+        static const std::vector<CurrencyId> empty;
+        return empty;
+    }
+
+public:
+    void clear() {
+        outgoing.clear();
+        incoming.clear();
+        edges = 0;
+    }
+
+    // adds or updates an edge; true if it is new
+    bool setEdge(CurrencyId from, CurrencyId to, double rate) {
+        std::size_t needed = std::max(from, to) + std::size_t{1};
+        if (outgoing.size() < needed) {
+            outgoing.resize(needed);
+            incoming.resize(needed);
+        }
+        for (Edge &edge : outgoing[from]) {
+            if (edge.to == to) {
+                edge.rate = rate;
+                return false;
+            }
+        }
+        outgoing[from].push_back({to, rate});
+        incoming[to].push_back(from);
+        ++edges;
+        return true;
+    }
+
+    std::size_t edgeCount() const { return edges; }
+
+    const std::vector<Edge> &edgesFrom(CurrencyId id) const {
+        return id < outgoing.size() ? outgoing[id] : noEdges();
+    }
+
+    const std::vector<CurrencyId> &sourcesInto(CurrencyId id) const {
+        return id < incoming.size() ? incoming[id] : noSources();
+    }
+
+    // nodes within maxDepth steps of start, following edges forwards or backwards
+    std::unordered_set<CurrencyId> reachable(CurrencyId start, bool forwards,
+                                             std::size_t maxDepth) const {
+        std::unordered_set<CurrencyId> seen{start};
+        std::vector<CurrencyId> frontier{start};
+        for (std::size_t depth = 0; depth < maxDepth && !frontier.empty(); ++depth) {
+            std::vector<CurrencyId> next;
+            for (CurrencyId node : frontier) {
+                if (forwards) {
+                    for (const Edge &edge : edgesFrom(node)) {
+                        if (seen.insert(edge.to).second) next.push_back(edge.to);
+                    }
+                } else {
+                    for (CurrencyId source : sourcesInto(node)) {
+                        if (seen.insert(source).second) next.push_back(source);
+                    }
+                }
+            }
+            frontier.swap(next);
+        }
+        return seen;
+    }
+};
+
+// Finds cycles of custom rates whose product is not 1: free money, or more
+// often a typo. The check is incremental. If the graph was consistent before
+// an edge changed, any new bad cycle runs through that edge, so only paths
+// from its head back to its tail are searched (Bellman-Ford on -log(rate) for
+// gains and +log(rate) for losses, over the nodes that can reach the tail).
+class ArbitrageDetector {
+public:
+    struct Cycle {
+        std::vector<CurrencyId> nodes;  // first == last
+        double product;
+    };
+
+private:
+    double tolerance;
+
+    // best path head -> tail; maximising the product when gain is true,
+    // minimising it otherwise
+    static std::optional<Cycle> extremePath(const RateGraph &graph, CurrencyId tail,
+                                            CurrencyId head, bool gain) {
+        std::unordered_set<CurrencyId> relevant =
+            graph.reachable(tail, false, std::numeric_limits<std::size_t>::max());
+        if (!relevant.count(head)) return std::nullopt;
+
+        // queue-based Bellman-Ford; relaxations are capped so a bad cycle
+        // elsewhere in the graph cannot keep it spinning
+        struct Label { double weight; CurrencyId parent; };
+        std::unordered_map<CurrencyId, Label> labels{{head, {0.0, head}}};
+        std::deque<CurrencyId> queue{head};
+        std::size_t budget = relevant.size() * (graph.edgeCount() + 1);
+        while (!queue.empty() && budget-- > 0) {
+            CurrencyId node = queue.front();
+            queue.pop_front();
+            double base = labels.at(node).weight;
+            for (const RateGraph::Edge &edge : graph.edgesFrom(node)) {
+                if (edge.to == head || !relevant.count(edge.to)) continue;
+                double logRate = std::log(edge.rate);
+                double weight  = base + (gain ? -logRate : logRate);
+                auto it = labels.find(edge.to);
+                if (it == labels.end() || weight < it->second.weight - 1e-12) {
+                    labels[edge.to] = {weight, node};
+                    queue.push_back(edge.to);
+                }
+            }
+        }
+
+        auto end = labels.find(tail);
+        if (end == labels.end()) return std::nullopt;
+
+        Cycle path;
+        path.product = std::exp(gain ? -end->second.weight : end->second.weight);
+        for (CurrencyId node = tail; node != head && path.nodes.size() <= relevant.size();
+             node = labels.at(node).parent) {
+            path.nodes.push_back(node);
+        }
+        path.nodes.push_back(head);
+        std::reverse(path.nodes.begin(), path.nodes.end());
+        return path;
+    }
+
+public:
+    explicit ArbitrageDetector(double relativeTolerance = 1e-4)
+        : tolerance(relativeTolerance) {}
+
+    // checks the cycles closed by edge from -> to
+    std::optional<Cycle> checkEdge(const RateGraph &graph, CurrencyId from, CurrencyId to) const {
+        double edgeRate = 0.0;
+        for (const RateGraph::Edge &edge : graph.edgesFrom(from)) {
+            if (edge.to == to) edgeRate = edge.rate;
+        }
+        if (edgeRate <= 0.0) return std::nullopt;
+
+        for (bool gain : {true, false}) {
+            std::optional<Cycle> back = extremePath(graph, from, to, gain);
+            if (!back) return std::nullopt;  // no way back to the tail at all
+
+            double product = edgeRate * back->product;
+            if (gain ? product > 1.0 + tolerance : product < 1.0 - tolerance) {
+                Cycle cycle;
+                cycle.nodes.push_back(from);
+                cycle.nodes.insert(cycle.nodes.end(), back->nodes.begin(), back->nodes.end());
+                cycle.product = product;
+                return cycle;
+            }
+        }
+        return std::nullopt;
+    }
+};
+
+// Resolves rates along chains of custom overrides. With EUR->GBP and GBP->JPY
+// overridden, EUR->JPY uses their product instead of falling back to base
+// rates. Pairs without a custom path are answered by the wrapped provider.
+//
+// Path results are memoised per pair. Changing an edge drops only the entries
+// whose path used it, plus (for a new edge, or under BestRate) the pairs the
+// edge could now connect: sources that reach its tail and targets reachable
+// from its head.
+class TriangulatingRateProvider final : public ExchangeRateProvider {
+public:
+    enum class PathPolicy {
+        MostDirect,  // fewest hops; a direct override always wins
+        BestRate,    // highest product within maxHops
+    };
+
+private:
+    struct CachedPath {
+        double rate = 0.0;             // 0.0 = no custom path
+        std::vector<CurrencyId> nodes; // from ... to
+    };
+
+    StaticRateProvider &inner;
+    PathPolicy policy;
+    std::size_t maxHops;
+
+    mutable std::shared_mutex mutex;
+    RateGraph graph;                               // custom overrides
+    ArbitrageDetector detector;
+    std::optional<ArbitrageDetector::Cycle> lastCycle;
+    std::atomic<std::uint64_t> edits{0};          // bumped after each change to graph
+    using MemoMap = std::unordered_map<std::uint64_t, CachedPath>;
+    mutable MemoMap memo;                          // pairKey -> path
+    mutable std::unordered_map<std::uint64_t, std::vector<std::uint64_t>> memoByEdge;  // edge -> pairs
+
+    CachedPath fewestHops(CurrencyId from, CurrencyId to) const {
+        struct Step { CurrencyId parent; double rate; };  // how BFS first reached a node
+        std::unordered_map<CurrencyId, Step> reachedBy{{from, {from, 1.0}}};
+        std::vector<CurrencyId> frontier{from};
+        for (std::size_t depth = 0; depth < maxHops && !frontier.empty(); ++depth) {
+            std::vector<CurrencyId> next;
+            for (CurrencyId node : frontier) {
+                for (const RateGraph::Edge &edge : graph.edgesFrom(node)) {
+                    if (!reachedBy.emplace(edge.to, Step{node, edge.rate}).second) continue;
+                    if (edge.to != to) {
+                        next.push_back(edge.to);
+                        continue;
+                    }
+
+                    CachedPath path;
+                    path.rate = 1.0;
+                    for (CurrencyId at = to; at != from; at = reachedBy.at(at).parent) {
+                        path.rate *= reachedBy.at(at).rate;
+                        path.nodes.push_back(at);
+                    }
+                    path.nodes.push_back(from);
+                    std::reverse(path.nodes.begin(), path.nodes.end());
+                    return path;
+                }
+            }
+            frontier.swap(next);
+        }
+        return {};
+    }
+
+    // hop-bounded Bellman-Ford on products: layer k holds the best rate
+    // reaching each node in exactly k hops
+    CachedPath bestProduct(CurrencyId from, CurrencyId to) const {
+        struct Reach { double rate; CurrencyId parent; };
+        std::vector<std::unordered_map<CurrencyId, Reach>> layers(1);
+        layers[0][from] = {1.0, from};
+
+        CachedPath best;
+        std::size_t bestLayer = 0;
+        for (std::size_t k = 1; k <= maxHops && !layers.back().empty(); ++k) {
+            std::unordered_map<CurrencyId, Reach> next;
+            for (const auto &entry : layers.back()) {
+                for (const RateGraph::Edge &edge : graph.edgesFrom(entry.first)) {
+                    double rate = entry.second.rate * edge.rate;
+                    auto it = next.find(edge.to);
+                    if (it == next.end() || rate > it->second.rate) {
+                        next[edge.to] = {rate, entry.first};
+                    }
+                }
+            }
+            layers.push_back(std::move(next));
+            auto hit = layers.back().find(to);
+            if (hit != layers.back().end() && hit->second.rate > best.rate) {
+                best.rate = hit->second.rate;
+                bestLayer = k;
+            }
+        }
+
+        if (best.rate == 0.0) return best;
+        CurrencyId node = to;
+        for (std::size_t k = bestLayer; k > 0; --k) {
+            best.nodes.push_back(node);
+            node = layers[k].at(node).parent;
+        }
+        best.nodes.push_back(from);
+        std::reverse(best.nodes.begin(), best.nodes.end());
+        return best;
+    }
+
+    // caller holds at least the shared lock
+    CachedPath search(CurrencyId from, CurrencyId to) const {
+        return policy == PathPolicy::MostDirect ? fewestHops(from, to) : bestProduct(from, to);
+    }
+
+    // caller holds the exclusive lock; keeps the first path stored for a pair.
+    // Edges are indexed before the entry exists, so a bad_alloc part way
+    // leaves at most stray index keys, never an entry invalidation cannot find.
+    void remember(std::uint64_t key, CachedPath path) const {
+        if (memo.count(key)) return;
+        for (std::size_t i = 0; i + 1 < path.nodes.size(); ++i) {
+            memoByEdge[pairKey(path.nodes[i], path.nodes[i + 1])].push_back(key);
+        }
+        memo.emplace(key, std::move(path));
+    }
+
+    // caller holds the exclusive lock
+    double lookupOrFill(CurrencyId from, CurrencyId to) const {
+        std::uint64_t key = pairKey(from, to);
+        auto it = memo.find(key);
+        if (it != memo.end()) return it->second.rate;
+        remember(key, search(from, to));
+        return memo.at(key).rate;
+    }
+
+    // erases a memoised pair along with its keys in memoByEdge
+    MemoMap::iterator forget(MemoMap::iterator entry) {
+        const std::vector<CurrencyId> &nodes = entry->second.nodes;
+        for (std::size_t i = 0; i + 1 < nodes.size(); ++i) {
+            auto users = memoByEdge.find(pairKey(nodes[i], nodes[i + 1]));
+            if (users == memoByEdge.end()) continue;
+            std::vector<std::uint64_t> &keys = users->second;
+            keys.erase(std::remove(keys.begin(), keys.end(), entry->first), keys.end());
+            if (keys.empty()) memoByEdge.erase(users);
+        }
+        return memo.erase(entry);
+    }
+
+    void invalidateAround(CurrencyId from, CurrencyId to, bool structural) {
+        auto users = memoByEdge.find(pairKey(from, to));
+        if (users != memoByEdge.end()) {
+            std::vector<std::uint64_t> keys = std::move(users->second);
+            memoByEdge.erase(users);
+            for (std::uint64_t key : keys) {
+                auto it = memo.find(key);
+                if (it != memo.end()) forget(it);
+            }
+        }
+        if (!structural) return;
+
+        std::unordered_set<CurrencyId> sources = graph.reachable(from, false, maxHops - 1);
+        std::unordered_set<CurrencyId> targets = graph.reachable(to, true, maxHops - 1);
+        for (auto it = memo.begin(); it != memo.end();) {
+            CurrencyId s = static_cast<CurrencyId>(it->first >> 32);
+            CurrencyId t = static_cast<CurrencyId>(it->first);
+            if (sources.count(s) && targets.count(t)) {
+                it = forget(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+public:
+    explicit TriangulatingRateProvider(StaticRateProvider &provider,
+                                       PathPolicy pathPolicy = PathPolicy::MostDirect,
+                                       std::size_t maxPathHops = 4)
+        : inner(provider), policy(pathPolicy), maxHops(std::max<std::size_t>(maxPathHops, 1)) {
+        resync();
+    }
+
+    using ExchangeRateProvider::tryGetRate;
+
+    // Rebuilds the edge set from the wrapped provider, e.g. after it loaded a
+    // rate book. Drops every memoised path.
+    void resync() {
+        std::shared_ptr<const RateBook> book = inner.snapshot();
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        graph.clear();
+        memo.clear();
+        memoByEdge.clear();
+        lastCycle.reset();
+        for (const auto &entry : book->getCustomRates().entries()) {
+            graph.setEdge(static_cast<CurrencyId>(entry.first >> 32),
+                          static_cast<CurrencyId>(entry.first), entry.second);
+        }
+        ++edits;
+    }
+
+    // the wrapped provider's changes plus our own; the inner one moves first
+    // on setCustomRate, ours after the graph has caught up
+    std::uint64_t getVersion() const noexcept override {
+        return inner.getVersion() + edits.load();
+    }
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        return inner.findCurrency(code);
+    }
+
+    int getMinorUnits(CurrencyId id) const override {
+        return inner.getMinorUnits(id);
+    }
+
+    // A cold pair is searched under the shared lock, so other readers carry
+    // on; the exclusive lock is held only to store the result, and the result
+    // is dropped if the graph changed meanwhile. The search and the memo
+    // allocate: running out of memory is reported, not thrown.
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        if (from == to) return inner.tryGetRate(from, to);
+
+        std::uint64_t key = pairKey(from, to);
+        try {
+            CachedPath path;
+            std::uint64_t searchedAt;
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex);
+                if (graph.edgeCount() == 0) return inner.tryGetRate(from, to);
+                auto it = memo.find(key);
+                if (it != memo.end()) {
+                    if (it->second.rate != 0.0) return it->second.rate;
+                    return inner.tryGetRate(from, to);
+                }
+                path       = search(from, to);
+                searchedAt = edits.load();
+            }
+
+            double rate = path.rate;
+            {
+                std::unique_lock<std::shared_mutex> lock(mutex);
+                if (edits.load() == searchedAt) remember(key, std::move(path));
+            }
+            if (rate != 0.0) return rate;
+        } catch (const std::bad_alloc &) {
+            return ConversionError::OutOfMemory;
+        }
+        return inner.tryGetRate(from, to);
+    }
+
+    void setCustomRate(const std::string &from, const std::string &to, double rate) override {
+        inner.setCustomRate(from, to, rate);
+        CurrencyId fromId = inner.findCurrency(from);
+        CurrencyId toId   = inner.findCurrency(to);
+        if (fromId == toId) return;  // dropped by the book too, never an edge
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        bool added = graph.setEdge(fromId, toId, rate);
+        invalidateAround(fromId, toId, added || policy == PathPolicy::BestRate);
+        lastCycle = detector.checkEdge(graph, fromId, toId);
+        ++edits;
+    }
+
+    // one inner publish, then one graph rebuild and memo flush for the lot
+    void applyUpdate(const RateUpdate &changes) override {
+        inner.applyUpdate(changes);
+        if (changes.overrides().empty()) return;  // base rates never feed custom paths
+
+        resync();
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (const RateUpdate::OverrideChange &change : changes.overrides()) {
+            lastCycle = detector.checkEdge(graph, inner.findCurrency(change.from),
+                                           inner.findCurrency(change.to));
+            if (lastCycle) break;
+        }
+    }
+
+    // cycle of custom rates with a product other than 1 created by the most
+    // recent setCustomRate, if any
+    std::optional<ArbitrageDetector::Cycle> lastInconsistency() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return lastCycle;
+    }
+
+    // the memoised path for a pair, e.g. {EUR, GBP, JPY}; empty if none
+    std::vector<CurrencyId> getPath(CurrencyId from, CurrencyId to) const {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        lookupOrFill(from, to);
+        return memo.at(pairKey(from, to)).nodes;
+    }
+};
+
+// Zero bits above the highest / below the lowest set bit; x must not be 0.
+inline unsigned countLeadingZeros(std::uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63u - static_cast<unsigned>(index);
+#else
+    unsigned n = 0;
+    for (std::uint64_t top = std::uint64_t{1} << 63; !(x & top); top >>= 1) ++n;
+    return n;
+#endif
+}
+
+inline unsigned countTrailingZeros(std::uint64_t x) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    unsigned n = 0;
+    for (; !(x & 1); x >>= 1) ++n;
+    return n;
+#endif
+}
+
+// Append-only bit stream over 64-bit words, most significant bit first.
+class BitWriter {
+    std::vector<std::uint64_t> &words;
+    unsigned used = 64;  // bits filled in words.back()
+
+public:
+    // appends to the given words; the stream starts on a fresh word
+    explicit BitWriter(std::vector<std::uint64_t> &target) : words(target) {}
+
+    // the low `bits` bits of value, 1 <= bits <= 64
+    void write(std::uint64_t value, unsigned bits) {
+        if (bits < 64) value &= (std::uint64_t{1} << bits) - 1;
+        if (used == 64) {
+            words.push_back(0);
+            used = 0;
+        }
+        unsigned room = 64 - used;
+        if (bits <= room) {
+            words.back() |= value << (room - bits);
+            used += bits;
+        } else {
+            unsigned spill = bits - room;
+            words.back() |= value >> spill;
+            words.push_back(value << (64 - spill));
+            used = spill;
+        }
+    }
+};
+
+class BitReader {
+    const std::uint64_t *words = nullptr;
+    std::size_t position = 0;  // in bits
+
+public:
+    BitReader() = default;
+    explicit BitReader(const std::uint64_t *start) : words(start) {}
+
+    // the next 64 bits, left aligned; the stream must be followed by a spare word
+    std::uint64_t peek() const {
+        std::size_t word = position >> 6;
+        unsigned offset  = static_cast<unsigned>(position & 63);
+        std::uint64_t value = words[word] << offset;
+        if (offset != 0) value |= words[word + 1] >> (64 - offset);
+        return value;
+    }
+
+    void skip(unsigned bits) { position += bits; }
+
+    // 1 <= bits <= 64
+    std::uint64_t read(unsigned bits) {
+        std::uint64_t value = peek() >> (64 - bits);
+        position += bits;
+        return value;
+    }
+};
+
+// One currency's rate history, stored the way Gorilla (Facebook's in-memory
+// time-series database) does it. Points are sealed into blocks of kBlockPoints.
+// Each block keeps its first timestamp and value raw. Every later timestamp is
+// stored as a delta-of-delta, and every later value as its XOR with the
+// previous value. Regular ticks then cost about one bit for the time, plus
+// the changed mantissa bits for the rate. Block start times are a separate
+// column, so an as-of query does a binary search over them and then decodes
+// one block. The newest points stay raw until their block fills.
+class RateSeries {
+public:
+    static constexpr std::size_t kBlockPoints = 64;
+
+private:
+    std::vector<std::uint64_t> bits;          // all sealed blocks, word aligned, + 1 spare
+    std::vector<std::int64_t> blockFirst;     // first timestamp per block
+    std::vector<std::size_t> blockOffset;     // first word per block
+    std::vector<std::int64_t> openTimes;      // unsealed tail
+    std::vector<double> openValues;
+    std::size_t sealedPoints = 0;
+    std::int64_t newest = 0;
+
+    static std::uint64_t toBits(double value) {
+        std::uint64_t raw;
+        std::memcpy(&raw, &value, sizeof raw);
+        return raw;
+    }
+
+    static double fromBits(std::uint64_t raw) {
+        double value;
+        std::memcpy(&value, &raw, sizeof value);
+        return value;
+    }
+
+    void seal() {
+        if (!bits.empty()) bits.pop_back();  // spare word, re-added below
+        blockFirst.push_back(openTimes.front());
+        blockOffset.push_back(bits.size());
+
+        BitWriter out(bits);
+        out.write(static_cast<std::uint64_t>(openTimes[0]), 64);
+        out.write(toBits(openValues[0]), 64);
+
+        std::uint64_t prevDelta = 0;
+        unsigned prevLeading = 64, prevTrailing = 0;  // 64 = no window yet
+        for (std::size_t i = 1; i < openTimes.size(); ++i) {
+            // unsigned arithmetic: wraps instead of overflowing, decodes the same way
+            std::uint64_t delta = static_cast<std::uint64_t>(openTimes[i]) -
+                                  static_cast<std::uint64_t>(openTimes[i - 1]);
+            std::int64_t dod = static_cast<std::int64_t>(delta - prevDelta);
+            std::uint64_t zigzag = (static_cast<std::uint64_t>(dod) << 1) ^
+                                   static_cast<std::uint64_t>(dod >> 63);
+            prevDelta = delta;
+            if (zigzag == 0) {
+                out.write(0b0, 1);
+            } else if (zigzag < (1u << 7)) {
+                out.write(0b10, 2);
+                out.write(zigzag, 7);
+            } else if (zigzag < (1u << 9)) {
+                out.write(0b110, 3);
+                out.write(zigzag, 9);
+            } else if (zigzag < (1u << 12)) {
+                out.write(0b1110, 4);
+                out.write(zigzag, 12);
+            } else {
+                out.write(0b1111, 4);
+                out.write(zigzag, 64);
+            }
+
+            std::uint64_t x = toBits(openValues[i]) ^ toBits(openValues[i - 1]);
+            if (x == 0) {
+                out.write(0b0, 1);
+                continue;
+            }
+            unsigned leading  = std::min(31u, countLeadingZeros(x));
+            unsigned trailing = countTrailingZeros(x);
+            if (prevLeading != 64 && leading >= prevLeading && trailing >= prevTrailing) {
+                out.write(0b10, 2);  // fits the previous window
+                out.write(x >> prevTrailing, 64 - prevLeading - prevTrailing);
+            } else {
+                unsigned length = 64 - leading - trailing;
+                out.write(0b11, 2);
+                out.write(leading, 5);
+                out.write(length - 1, 6);
+                out.write(x >> trailing, length);
+                prevLeading  = leading;
+                prevTrailing = trailing;
+            }
+        }
+
+        bits.push_back(0);  // lets BitReader::peek run past the last block
+        sealedPoints += openTimes.size();
+        openTimes.clear();
+        openValues.clear();
+    }
+
+    // walks the points of one sealed block in order
+    struct BlockDecoder {
+        BitReader in;
+        std::uint64_t time = 0, value = 0, delta = 0;
+        unsigned leading = 0, trailing = 0;
+        std::size_t remaining = 0;  // points after the current one
+
+        BlockDecoder() = default;
+        explicit BlockDecoder(const std::uint64_t *words) : in(words) {
+            time  = in.read(64);
+            value = in.read(64);
+            remaining = kBlockPoints - 1;
+        }
+
+        std::int64_t timestamp() const { return static_cast<std::int64_t>(time); }
+        double rate() const { return fromBits(value); }
+
+        // moves to the next point; false at the end of the block
+        bool next() {
+            if (remaining == 0) return false;
+            --remaining;
+
+            // timestamp prefix: count of leading 1 bits (0-4) picks the width
+            static constexpr unsigned kPrefix[] = {1, 2, 3, 4, 4};
+            static constexpr unsigned kWidth[]  = {0, 7, 9, 12, 64};
+            unsigned ones = countLeadingZeros(~in.peek() | (std::uint64_t{1} << 59));
+            in.skip(kPrefix[ones]);
+            std::uint64_t zigzag = kWidth[ones] ? in.read(kWidth[ones]) : 0;
+            delta += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+            time += delta;
+
+            std::uint64_t control = in.peek();
+            if (control >> 63 == 0) {  // 0: value unchanged
+                in.skip(1);
+                return true;
+            }
+            if (control >> 62 == 0b11) {  // 11: new window follows
+                leading  = static_cast<unsigned>(control >> 57) & 31;
+                trailing = 64 - leading - ((static_cast<unsigned>(control >> 51) & 63) + 1);
+                in.skip(13);
+            } else {  // 10: reuse the previous window
+                in.skip(2);
+            }
+            value ^= in.read(64 - leading - trailing) << trailing;
+            return true;
+        }
+    };
+
+    // last value at or before timestamp within a sealed block
+    double scanBlock(std::size_t block, std::int64_t timestamp) const {
+        BlockDecoder decoder(bits.data() + blockOffset[block]);
+        double rate = decoder.rate();
+        while (decoder.next() && decoder.timestamp() <= timestamp) rate = decoder.rate();
+        return rate;
+    }
+
+public:
+    // timestamps must not go backwards; equal ones are allowed, the later wins
+    void append(std::int64_t timestamp, double value) {
+        if (size() > 0 && timestamp < newest) {
+            throw std::invalid_argument("Rate history must be recorded in time order");
+        }
+        newest = timestamp;
+        openTimes.push_back(timestamp);
+        openValues.push_back(value);
+        if (openTimes.size() == kBlockPoints) seal();
+    }
+
+    std::size_t size() const { return sealedPoints + openTimes.size(); }
+
+    // value in force at timestamp, or 0.0 if the series starts later
+    double valueAt(std::int64_t timestamp) const {
+        if (!openTimes.empty() && timestamp >= openTimes.front()) {
+            auto it = std::upper_bound(openTimes.begin(), openTimes.end(), timestamp);
+            return openValues[static_cast<std::size_t>(it - openTimes.begin()) - 1];
+        }
+        auto it = std::upper_bound(blockFirst.begin(), blockFirst.end(), timestamp);
+        if (it == blockFirst.begin()) return 0.0;
+        return scanBlock(static_cast<std::size_t>(it - blockFirst.begin()) - 1, timestamp);
+    }
+
+    // Reads the series forwards for a run of non-decreasing timestamps,
+    // decoding each block once instead of once per lookup. The series must
+    // not change while a cursor is in use. A default-constructed cursor reads
+    // 1.0 throughout (the base currency's rate).
+    class Cursor {
+        const RateSeries *series = nullptr;
+        std::size_t nextBlock = 0;  // sealed block to open once the current one ends
+        std::size_t nextOpen  = 0;  // unsealed point to read after the last block
+        BlockDecoder decoder;
+        bool inBlock = false;
+
+        bool hasPending = false;    // next point, not yet in force
+        std::int64_t pendingTime = 0;
+        double pendingRate = 0.0;
+        double current = 1.0;
+
+        void fetch() {
+            if (inBlock && decoder.next()) {
+                pendingTime = decoder.timestamp();
+                pendingRate = decoder.rate();
+                return;
+            }
+            inBlock = false;
+            if (nextBlock < series->blockFirst.size()) {
+                decoder = BlockDecoder(series->bits.data() + series->blockOffset[nextBlock++]);
+                inBlock = true;
+                pendingTime = decoder.timestamp();
+                pendingRate = decoder.rate();
+            } else if (nextOpen < series->openTimes.size()) {
+                pendingTime = series->openTimes[nextOpen];
+                pendingRate = series->openValues[nextOpen];
+                ++nextOpen;
+            } else {
+                hasPending = false;
+            }
+        }
+
+    public:
+        Cursor() = default;
+
+        // positioned for lookups at or after start
+        Cursor(const RateSeries &source, std::int64_t start) : series(&source), current(0.0) {
+            if (!source.openTimes.empty() && start >= source.openTimes.front()) {
+                nextBlock = source.blockFirst.size();
+            } else {
+                auto it = std::upper_bound(source.blockFirst.begin(), source.blockFirst.end(), start);
+                if (it != source.blockFirst.begin()) --it;
+                nextBlock = static_cast<std::size_t>(it - source.blockFirst.begin());
+            }
+            hasPending = true;
+            fetch();
+        }
+
+        // value in force at timestamp (0.0 before the series starts); calls
+        // must not go back in time
+        double advanceTo(std::int64_t timestamp) {
+            while (hasPending && pendingTime <= timestamp) {
+                current = pendingRate;
+                fetch();
+            }
+            return current;
+        }
+    };
+
+    Cursor cursor(std::int64_t start) const { return Cursor(*this, start); }
+
+    void shrinkToFit() {
+        bits.shrink_to_fit();
+        blockFirst.shrink_to_fit();
+        blockOffset.shrink_to_fit();
+    }
+
+    std::size_t memoryBytes() const {
+        return bits.capacity() * sizeof(std::uint64_t) +
+               blockFirst.capacity() * sizeof(std::int64_t) +
+               blockOffset.capacity() * sizeof(std::size_t) +
+               openTimes.capacity() * sizeof(std::int64_t) +
+               openValues.capacity() * sizeof(double);
+    }
+};
+
+// Rates over time, for revaluing past transactions at trade-date rates. Each
+// currency has a RateSeries of its rate against the base currency; the
+// cross rate at time t is the ratio of the two rates in force at t. As a
+// plain ExchangeRateProvider it answers with the newest rates.
+class HistoricalRateProvider final : public ExchangeRateProvider {
+    mutable std::shared_mutex mutex;
+    CurrencyRegistry registry;
+    CurrencyId baseId;
+    std::vector<RateSeries> series;  // by id; the base currency's stays empty
+    std::atomic<std::uint64_t> version{0};
+
+    // caller holds the lock
+    double rateVsBase(CurrencyId id, std::int64_t timestamp) const {
+        return id == baseId ? 1.0 : series[id].valueAt(timestamp);
+    }
+
+public:
+    explicit HistoricalRateProvider(const std::string &baseCode) {
+        baseId = registry.intern(baseCode);
+        series.resize(registry.size());
+    }
+
+    using ExchangeRateProvider::tryGetRate;
+    using ExchangeRateProvider::getRate;
+
+    // 1 base = rateVsBase units of code, from timestamp on
+    void record(const std::string &code, std::int64_t timestamp, double rateVsBase) {
+        if (!(rateVsBase > 0.0)) {
+            throw std::invalid_argument("Rate must be positive");
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        CurrencyId id = registry.intern(code);
+        if (id == baseId) {
+            throw std::invalid_argument("The base currency's rate is always 1");
+        }
+        if (series.size() < registry.size()) series.resize(registry.size());
+        series[id].append(timestamp, rateVsBase);
+        ++version;  // the newest rates changed
+    }
+
+    std::uint64_t getVersion() const noexcept override { return version.load(); }
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return registry.find(code);
+    }
+
+    // multiplier for converting from -> to with the rates in force at timestamp
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to,
+                              std::int64_t timestamp) const noexcept {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (from >= series.size() || to >= series.size()) {
+            return ConversionError::UnsupportedCurrency;
+        }
+        if (from == to) return 1.0;
+        double rateFrom = rateVsBase(from, timestamp);
+        double rateTo   = rateVsBase(to, timestamp);
+        if (rateFrom == 0.0 || rateTo == 0.0) return ConversionError::NoRateAtTime;
+        return rateTo / rateFrom;
+    }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        return tryGetRate(from, to, std::numeric_limits<std::int64_t>::max());
+    }
+
+    double getRate(const std::string &from, const std::string &to, std::int64_t timestamp) const {
+        return tryGetRate(findCurrency(from), findCurrency(to), timestamp).valueOrThrow();
+    }
+
+    // Read access for bulk passes: holds the shared lock for its lifetime, so
+    // series can be walked with cursors instead of relocking per row.
+    class View {
+        std::shared_lock<std::shared_mutex> lock;
+        const HistoricalRateProvider *owner;
+
+    public:
+        explicit View(const HistoricalRateProvider &provider)
+            : lock(provider.mutex), owner(&provider) {}
+
+        bool contains(CurrencyId id) const { return id < owner->series.size(); }
+
+        // cursor over id's rate vs base, starting at start
+        RateSeries::Cursor cursor(CurrencyId id, std::int64_t start) const {
+            if (id == owner->baseId) return RateSeries::Cursor();
+            return owner->series[id].cursor(start);
+        }
+    };
+
+    View view() const { return View(*this); }
+
+    // points recorded across all currencies
+    std::size_t pointCount() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::size_t total = 0;
+        for (const RateSeries &s : series) total += s.size();
+        return total;
+    }
+
+    std::size_t memoryBytes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::size_t total = 0;
+        for (const RateSeries &s : series) total += s.memoryBytes();
+        return total;
+    }
+
+    // releases the slack left by vector growth once loading is done
+    void shrinkToFit() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (RateSeries &s : series) s.shrinkToFit();
+    }
+};
+
+struct QuoteCacheStats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+
+    double hitRate() const {
+        std::uint64_t total = hits + misses;
+        return total ? static_cast<double>(hits) / static_cast<double>(total) : 0.0;
+    }
+};
+
+// Small direct-mapped cache of recent quotes in front of a provider, one
+// table per thread, for skewed traffic where a few pairs make up most
+// requests. An entry is served only while the provider's version is still
+// the one it was read at, so a rate change is seen on the next lookup.
+// Providers reporting kUnversioned, and failed lookups, are never cached.
+template <typename Provider>
+class QuoteCache final : public ExchangeRateProvider {
+    static constexpr unsigned kIndexBits = 8;     // 256 entries, 8 KiB per thread
+    static constexpr std::size_t kStatSlots = 32;
+
+    struct Entry {          // trivial, so the thread_local table needs no guard
+        std::uint64_t key;
+        std::uint64_t version;
+        double rate;
+        std::uint32_t owner;  // cache instance that filled it; 0 = empty
+    };
+
+    // hit/miss counts per thread slot, one cache line each. Threads own a
+    // slot, so plain load+store suffices; past kStatSlots threads, counts
+    // may lose a few increments.
+    struct alignas(64) StatSlot {
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> misses{0};
+    };
+
+    Provider &inner;
+    std::uint32_t owner;
+    mutable StatSlot stats[kStatSlots];
+
+    static Entry *table() {
+        thread_local Entry entries[std::size_t{1} << kIndexBits];
+        return entries;
+    }
+
+    static std::size_t threadSlot() {
+        static std::atomic<std::size_t> nextSlot{0};
+        thread_local std::size_t slot = nextSlot.fetch_add(1) % kStatSlots;
+        return slot;
+    }
+
+    static void bump(std::atomic<std::uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static std::uint32_t nextOwner() {
+        static std::atomic<std::uint32_t> owners{0};
+        return ++owners;
+    }
+
+public:
+    explicit QuoteCache(Provider &provider) : inner(provider), owner(nextOwner()) {}
+
+    using ExchangeRateProvider::tryGetRate;
+
+    CurrencyId findCurrency(const std::string &code) const override {
+        return inner.findCurrency(code);
+    }
+
+    int getMinorUnits(CurrencyId id) const override {
+        return inner.getMinorUnits(id);
+    }
+
+    std::uint64_t getVersion() const noexcept override { return inner.getVersion(); }
+
+    Result<double> tryGetRate(CurrencyId from, CurrencyId to) const noexcept override {
+        std::uint64_t version = inner.getVersion();  // before the rate it validates
+        if (version == kUnversioned) return inner.tryGetRate(from, to);
+
+        std::uint64_t key = pairKey(from, to);
+        Entry &entry = table()[(key * 0x9E3779B97F4A7C15ull) >> (64 - kIndexBits)];
+        StatSlot &slot = stats[threadSlot()];
+        if (entry.owner == owner && entry.key == key && entry.version == version) {
+            bump(slot.hits);
+            return entry.rate;
+        }
+
+        bump(slot.misses);
+        Result<double> rate = inner.tryGetRate(from, to);
+        if (rate.ok()) entry = {key, version, rate.value(), owner};
+        return rate;
+    }
+
+    void setCustomRate(const std::string &from, const std::string &to, double rate) override {
+        inner.setCustomRate(from, to, rate);
+    }
+
+    void applyUpdate(const RateUpdate &update) override { inner.applyUpdate(update); }
+
+    // totals over all threads
+    QuoteCacheStats getStats() const {
+        QuoteCacheStats total;
+        for (const StatSlot &slot : stats) {
+            total.hits   += slot.hits.load(std::memory_order_relaxed);
+            total.misses += slot.misses.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// ------------------------ Batch Kernels ------------------------
+
+// Multiply kernels used by CurrencyConverter::convertBatch. Each returns true if
+// any input amount was negative, so validation costs no extra pass over the
+// data in the common (all valid) case. in and out may alias.
+class BatchKernels {
+public:
+    using ScaleFn    = bool (*)(const double *in, double *out, std::size_t n, double rate);
+    using MultiplyFn = bool (*)(const double *in, const double *rates, double *out, std::size_t n);
+
+    ScaleFn     scale;     // out[i] = in[i] * rate
+    MultiplyFn  multiply;  // out[i] = in[i] * rates[i]
+    const char *name;
+
+    // widest kernel set the running CPU supports, detected once
+    static const BatchKernels &best() {
+        static const BatchKernels kernels = detect();
+        return kernels;
+    }
+
+private:
+    static BatchKernels detect() {
+#ifdef CURRENCY_CONVERTER_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return {scaleAvx512, multiplyAvx512, "avx512"};
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return {scaleAvx2, multiplyAvx2, "avx2"};
+        }
+#endif
+        return {scaleScalar, multiplyScalar, "scalar"};
+    }
+
+    static bool scaleScalar(const double *in, double *out, std::size_t n, double rate) {
+        bool anyNegative = false;
+        for (std::size_t i = 0; i < n; ++i) {
+            anyNegative |= in[i] < 0.0;
+            out[i] = in[i] * rate;
+        }
+        return anyNegative;
+    }
+
+    static bool multiplyScalar(const double *in, const double *rates, double *out, std::size_t n) {
+        bool anyNegative = false;
+        for (std::size_t i = 0; i < n; ++i) {
+            anyNegative |= in[i] < 0.0;
+            out[i] = in[i] * rates[i];
+        }
+        return anyNegative;
+    }
+
+#ifdef CURRENCY_CONVERTER_X86_SIMD
+    __attribute__((target("avx2")))
+    static bool scaleAvx2(const double *in, double *out, std::size_t n, double rate) {
+        const __m256d vrate = _mm256_set1_pd(rate);
+        const __m256d zero  = _mm256_setzero_pd();
+        __m256d negative    = zero;
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(in + i);
+            negative = _mm256_or_pd(negative, _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(x, vrate));
+        }
+        bool anyNegative = _mm256_movemask_pd(negative) != 0;
+        return scaleScalar(in + i, out + i, n - i, rate) || anyNegative;
+    }
+
+    __attribute__((target("avx2")))
+    static bool multiplyAvx2(const double *in, const double *rates, double *out, std::size_t n) {
+        const __m256d zero = _mm256_setzero_pd();
+        __m256d negative   = zero;
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256d x = _mm256_loadu_pd(in + i);
+            negative = _mm256_or_pd(negative, _mm256_cmp_pd(x, zero, _CMP_LT_OQ));
+            _mm256_storeu_pd(out + i, _mm256_mul_pd(x, _mm256_loadu_pd(rates + i)));
+        }
+        bool anyNegative = _mm256_movemask_pd(negative) != 0;
+        return multiplyScalar(in + i, rates + i, out + i, n - i) || anyNegative;
+    }
+
+    __attribute__((target("avx512f")))
+    static bool scaleAvx512(const double *in, double *out, std::size_t n, double rate) {
+        const __m512d vrate = _mm512_set1_pd(rate);
+        const __m512d zero  = _mm512_setzero_pd();
+        __mmask8 negative   = 0;
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m512d x = _mm512_loadu_pd(in + i);
+            negative |= _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ);
+            _mm512_storeu_pd(out + i, _mm512_mul_pd(x, vrate));
+        }
+        if (i < n) {
+            __mmask8 tail = static_cast<__mmask8>((1u << (n - i)) - 1);
+            __m512d x = _mm512_maskz_loadu_pd(tail, in + i);
+            negative |= _mm512_mask_cmp_pd_mask(tail, x, zero, _CMP_LT_OQ);
+            _mm512_mask_storeu_pd(out + i, tail, _mm512_mul_pd(x, vrate));
+        }
+        return negative != 0;
+    }
+
+    __attribute__((target("avx512f")))
+    static bool multiplyAvx512(const double *in, const double *rates, double *out, std::size_t n) {
+        const __m512d zero = _mm512_setzero_pd();
+        __mmask8 negative  = 0;
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m512d x = _mm512_loadu_pd(in + i);
+            negative |= _mm512_cmp_pd_mask(x, zero, _CMP_LT_OQ);
+            _mm512_storeu_pd(out + i, _mm512_mul_pd(x, _mm512_loadu_pd(rates + i)));
+        }
+        if (i < n) {
+            __mmask8 tail = static_cast<__mmask8>((1u << (n - i)) - 1);
+            __m512d x = _mm512_maskz_loadu_pd(tail, in + i);
+            negative |= _mm512_mask_cmp_pd_mask(tail, x, zero, _CMP_LT_OQ);
+            _mm512_mask_storeu_pd(out + i, tail,
+                                  _mm512_mul_pd(x, _mm512_maskz_loadu_pd(tail, rates + i)));
+        }
+        return negative != 0;
+    }
+#endif
+};
+
+// ------------------------ Application Layer ------------------------
+
+// Outcome of a batch conversion. Rows with a negative amount are not
+// converted: their output is NaN and their index is listed here.
+struct BatchReport {
+    std::vector<std::size_t> negativeIndices;
+    std::vector<std::size_t> overflowIndices;   // exact (Money) batches only
+
+    // provider version read before the batch's lookups; exactly the rates
+    // used when the provider is a RateSnapshot
+    std::uint64_t version = ExchangeRateProvider::kUnversioned;
+
+    bool ok() const { return negativeIndices.empty() && overflowIndices.empty(); }
+};
+
+// Conversion logic over any provider type with the ExchangeRateProvider
+// lookup API. Binding a concrete (final) provider such as StaticRateProvider
+// resolves every rate lookup at compile time, so lookup and multiply inline
+// into the caller; CurrencyConverter keeps runtime polymorphism.
+template <typename Provider>
+class BasicCurrencyConverter {
+    Provider &rateProvider;
+
+public:
+    explicit BasicCurrencyConverter(Provider &provider)
+        : rateProvider(provider) {}
+
+    // resolves a code for the id-based overloads
+    CurrencyId findCurrency(const std::string &code) const { return rateProvider.findCurrency(code); }
+
+    // decimals amounts in this currency are shown with (2 when unknown)
+    int getMinorUnits(CurrencyId id) const { return rateProvider.getMinorUnits(id); }
+
+    // version of the rates conversions currently see (see BatchReport::version)
+    std::uint64_t getRateVersion() const noexcept { return rateProvider.getVersion(); }
+
+    // Resolves both codes through Provider rather than the base class's
+    // string overload, so a final provider is called statically end to end.
+    Result<double> tryConvert(const std::string &from, const std::string &to,
+                              double amount) const noexcept {
+        if (!std::isfinite(amount)) {
+            return ConversionError::AmountOutOfRange;
+        }
+        if (amount < 0.0) {
+            return ConversionError::NegativeAmount;
+        }
+        if (from == to) return amount;  // as ExchangeRateProvider::tryGetRate(code, code)
+        return tryConvert(rateProvider.findCurrency(from), rateProvider.findCurrency(to), amount);
+    }
+
+    // id-based overload for callers that resolved their codes up front
+    Result<double> tryConvert(CurrencyId from, CurrencyId to, double amount) const noexcept {
+        if (!std::isfinite(amount)) {
+            return ConversionError::AmountOutOfRange;
+        }
+        if (amount < 0.0) {
+            return ConversionError::NegativeAmount;
+        }
+        Result<double> rate = rateProvider.tryGetRate(from, to);
+        if (!rate) return rate;
+        return amount * rate.value();
+    }
+
+    // throwing wrappers, kept for existing callers
+    double convert(const std::string &from, const std::string &to, double amount) const {
+        return tryConvert(from, to, amount).valueOrThrow();
+    }
+
+    double convert(CurrencyId from, CurrencyId to, double amount) const {
+        return tryConvert(from, to, amount).valueOrThrow();
+    }
+
+    // Exact conversion of a Money amount, rounded to the target's minor unit.
+    Result<Money> tryConvert(const Money &amount, CurrencyId to) const noexcept {
+        if (amount.getMinorAmount() < 0) {
+            return ConversionError::NegativeAmount;
+        }
+        Result<MinorUnitConversion> conversion = prepareExact(amount.getCurrency(), to);
+        if (!conversion) return conversion.error();
+
+        Result<std::int64_t> units = conversion.value().apply(amount.getMinorAmount());
+        if (!units) return units.error();
+        return Money(units.value(), to);
+    }
+
+    Money convert(const Money &amount, CurrencyId to) const {
+        return tryConvert(amount, to).valueOrThrow();
+    }
+
+    // Exact batch over amounts in minor units: one rate lookup, then integer
+    // arithmetic only. Rejected rows are set to 0 and listed in the report.
+    BatchReport convertBatch(CurrencyId from, CurrencyId to,
+                             const std::int64_t *in, std::int64_t *out, std::size_t count) const {
+        BatchReport report;
+        report.version = rateProvider.getVersion();
+        MinorUnitConversion conversion = prepareExact(from, to).valueOrThrow();
+        for (std::size_t i = 0; i < count; ++i) {
+            std::int64_t amount = in[i];
+            Result<std::int64_t> units = conversion.apply(amount);
+            out[i] = amount >= 0 && units ? units.value() : 0;
+            if (amount < 0) {
+                report.negativeIndices.push_back(i);
+            } else if (!units) {
+                report.overflowIndices.push_back(i);
+            }
+        }
+        return report;
+    }
+
+    // Converts count amounts with a single rate lookup. in and out may alias.
+    BatchReport convertBatch(CurrencyId from, CurrencyId to,
+                             const double *in, double *out, std::size_t count) const {
+        std::uint64_t version = rateProvider.getVersion();
+        return scaleBatch(rateProvider.tryGetRate(from, to).valueOrThrow(), version,
+                          in, out, count);
+    }
+
+    BatchReport convertBatch(const std::string &from, const std::string &to,
+                             const std::vector<double> &in, std::vector<double> &out) const {
+        out.resize(in.size());
+        std::uint64_t version = rateProvider.getVersion();
+        return scaleBatch(rateProvider.tryGetRate(from, to).valueOrThrow(), version,
+                          in.data(), out.data(), in.size());
+    }
+
+    // Mixed-pair variant: row i converts in[i] along pairs[i]. Each distinct
+    // pair is looked up once, then the rates are applied in one vector pass.
+    BatchReport convertBatch(const CurrencyPair *pairs, const double *in, double *out,
+                             std::size_t count) const {
+        BatchReport report;
+        report.version = rateProvider.getVersion();
+        std::vector<double> rates(count);
+        std::unordered_map<std::uint64_t, double> resolved;
+        for (std::size_t i = 0; i < count; ++i) {
+            auto inserted = resolved.emplace(pairKey(pairs[i].from, pairs[i].to), 0.0);
+            if (inserted.second) {
+                inserted.first->second =
+                    rateProvider.tryGetRate(pairs[i].from, pairs[i].to).valueOrThrow();
+            }
+            rates[i] = inserted.first->second;
+        }
+
+        if (BatchKernels::best().multiply(in, rates.data(), out, count)) {
+            rejectNegatives(in, out, count, report);
+        }
+        return report;
+    }
+
+private:
+    Result<MinorUnitConversion> prepareExact(CurrencyId from, CurrencyId to) const noexcept {
+        Result<double> rate = rateProvider.tryGetRate(from, to);
+        if (!rate) return rate.error();
+        return MinorUnitConversion(FixedRate::fromDouble(rate.value()),
+                                   rateProvider.getMinorUnits(from),
+                                   rateProvider.getMinorUnits(to));
+    }
+
+    static BatchReport scaleBatch(double rate, std::uint64_t version,
+                                  const double *in, double *out, std::size_t count) {
+        BatchReport report;
+        report.version = version;
+        if (BatchKernels::best().scale(in, out, count, rate)) {
+            rejectNegatives(in, out, count, report);
+        }
+        return report;
+    }
+
+    static void rejectNegatives(const double *in, double *out, std::size_t count,
+                                BatchReport &report) {
+        for (std::size_t i = 0; i < count; ++i) {
+            // when converting in place the input is gone; rates are positive, so
+            // the converted value carries the same sign
+            if (in == out ? out[i] < 0.0 : in[i] < 0.0) {
+                report.negativeIndices.push_back(i);
+                out[i] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+    }
+};
+
+using CurrencyConverter = BasicCurrencyConverter<ExchangeRateProvider>;
+
+// Transactions to revalue, one column per field. Rows must be sorted by
+// (from, to, timestamp), i.e. by pairKey(from, to) and then by time.
+struct TransactionColumns {
+    std::vector<CurrencyId> from;
+    std::vector<CurrencyId> to;
+    std::vector<std::int64_t> timestamps;
+    std::vector<double> amounts;
+
+    std::size_t size() const { return amounts.size(); }
+};
+
+// Revalued transactions, column per field. Rows with no rate at their time
+// (or an unknown currency) get NaN in both columns and are listed in
+// unpricedIndices.
+struct RepricedColumns {
+    std::vector<double> rates;
+    std::vector<double> amounts;
+    std::vector<std::size_t> unpricedIndices;
+
+    bool ok() const { return unpricedIndices.empty(); }
+};
+
+// Revalues transactions at the rates in force at their timestamps, as a
+// sort-merge join. Because rows arrive sorted, each pair's run walks both
+// currencies' rate series forwards with cursors. Every compressed block is
+// decoded once per run, instead of one binary search and partial decode per
+// row. Amounts keep their sign, so refunds revalue too.
+class RepricingJoin {
+    const HistoricalRateProvider &history;
+
+public:
+    explicit RepricingJoin(const HistoricalRateProvider &provider) : history(provider) {}
+
+    // throws std::invalid_argument if the rows are not sorted
+    RepricedColumns run(const TransactionColumns &rows) const {
+        const std::size_t n = rows.size();
+        if (rows.from.size() != n || rows.to.size() != n || rows.timestamps.size() != n) {
+            throw std::invalid_argument("Transaction columns differ in length");
+        }
+
+        RepricedColumns out;
+        out.rates.resize(n);
+        out.amounts.resize(n);
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+
+        HistoricalRateProvider::View view = history.view();
+        std::size_t begin = 0;
+        while (begin < n) {
+            CurrencyId from = rows.from[begin];
+            CurrencyId to   = rows.to[begin];
+            std::size_t end = begin + 1;
+            while (end < n && rows.from[end] == from && rows.to[end] == to) {
+                if (rows.timestamps[end] < rows.timestamps[end - 1]) {
+                    throw std::invalid_argument("Transactions must be sorted by pair and time");
+                }
+                ++end;
+            }
+            if (end < n && pairKey(rows.from[end], rows.to[end]) < pairKey(from, to)) {
+                throw std::invalid_argument("Transactions must be sorted by pair and time");
+            }
+
+            if (from == to && view.contains(from)) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    out.rates[i]   = 1.0;
+                    out.amounts[i] = rows.amounts[i];
+                }
+            } else if (view.contains(from) && view.contains(to)) {
+                std::int64_t start = rows.timestamps[begin];
+                RateSeries::Cursor fromRates = view.cursor(from, start);
+                RateSeries::Cursor toRates   = view.cursor(to, start);
+                for (std::size_t i = begin; i < end; ++i) {
+                    double rateFrom = fromRates.advanceTo(rows.timestamps[i]);
+                    double rateTo   = toRates.advanceTo(rows.timestamps[i]);
+                    if (rateFrom == 0.0 || rateTo == 0.0) {
+                        out.rates[i] = out.amounts[i] = nan;
+                        out.unpricedIndices.push_back(i);
+                        continue;
+                    }
+                    double rate = rateTo / rateFrom;
+                    out.rates[i]   = rate;
+                    out.amounts[i] = rows.amounts[i] * rate;
+                }
+            } else {
+                for (std::size_t i = begin; i < end; ++i) {
+                    out.rates[i] = out.amounts[i] = nan;
+                    out.unpricedIndices.push_back(i);
+                }
+            }
+            begin = end;
+        }
+        return out;
+    }
+};
+
+// ------------------------ Network Layer ------------------------
+
+// Wire format of the conversion server. Every message starts with a 16-bit
+// length counting the bytes after it, so a reader can cut frames without
+// parsing them. Fields are in host byte order (little-endian on every
+// platform the server builds on).
+//
+//   request  = RequestHeader | from code | to code
+//   response = Response
+//
+// A connection may send any number of requests without waiting; responses
+// come back in request order and echo the request's tag.
+struct WireProtocol {
+    struct RequestHeader {
+        std::uint16_t length;       // sizeof(RequestHeader) - 2 + fromLength + toLength
+        std::uint8_t  fromLength;
+        std::uint8_t  toLength;
+        std::uint32_t tag;          // chosen by the client, echoed back
+        double        amount;
+    };
+
+    struct Response {
+        std::uint16_t length;       // always sizeof(Response) - 2
+        std::uint8_t  status;       // ConversionError; None on success
+        std::uint8_t  reserved;
+        std::uint32_t tag;
+        double        value;        // converted amount, 0 on failure
+    };
+
+    static_assert(sizeof(RequestHeader) == 16 && sizeof(Response) == 16,
+                  "wire records must be packed");
+
+    static constexpr std::size_t kMaxRequest = sizeof(RequestHeader) + 2 * 255;
+
+    // writes one request to out (at least kMaxRequest bytes); returns its size
+    static std::size_t encodeRequest(char *out, const std::string &from, const std::string &to,
+                                     double amount, std::uint32_t tag) {
+        if (from.size() > 255 || to.size() > 255) {
+            throw std::invalid_argument("Currency code too long");
+        }
+        RequestHeader header{};
+        header.length     = static_cast<std::uint16_t>(sizeof(header) - 2 + from.size() + to.size());
+        header.fromLength = static_cast<std::uint8_t>(from.size());
+        header.toLength   = static_cast<std::uint8_t>(to.size());
+        header.tag        = tag;
+        header.amount     = amount;
+        std::memcpy(out, &header, sizeof(header));
+        std::memcpy(out + sizeof(header), from.data(), from.size());
+        std::memcpy(out + sizeof(header) + from.size(), to.data(), to.size());
+        return sizeof(header) + from.size() + to.size();
+    }
+};
+
+#ifdef CURRENCY_CONVERTER_EPOLL
+
+// Serves WireProtocol requests over TCP. Each reactor thread owns a
+// listening socket on the shared port (SO_REUSEPORT, so the kernel spreads
+// new connections across them), an epoll set and its connections; nothing
+// is shared between reactors except the converter. A readable connection
+// is drained, every complete request in its buffer is answered, and all
+// the responses leave in one send. A connection whose client stops reading
+// is not read again until its responses drain.
+class ConversionServer {
+    static constexpr std::size_t kReadBuffer = 1 << 16;
+    static constexpr std::size_t kMaxPendingOutput = 1 << 20;
+    static constexpr int kMaxEvents = 256;
+
+    struct Connection {
+        int fd = -1;
+        std::uint32_t interest = 0;     // epoll events currently registered
+        std::vector<char> in = std::vector<char>(kReadBuffer);
+        std::size_t inUsed = 0;
+        std::vector<char> out;
+        std::size_t outSent = 0;
+
+        std::size_t pendingOutput() const { return out.size() - outSent; }
+    };
+
+    struct alignas(64) Reactor {
+        int epollFd = -1;
+        int listenFd = -1;
+        int wakeFd = -1;                // eventfd; written by stop()
+        std::atomic<std::uint64_t> served{0};   // only the reactor thread writes it
+        std::thread thread;
+        std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    };
+
+    const CurrencyConverter &converter;
+    std::string host;
+    std::uint16_t port;
+    std::vector<std::unique_ptr<Reactor>> reactors;
+    std::atomic<bool> stopped{false};
+
+    int openListener(std::uint16_t onPort) const {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port   = htons(onPort);
+        if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            throw std::invalid_argument("Not an IPv4 address: " + host);
+        }
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw std::runtime_error("Cannot create socket");
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+            ::listen(fd, 1024) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot listen on " + host + ":" + std::to_string(onPort));
+        }
+        return fd;
+    }
+
+    static void watch(Reactor &reactor, int fd, std::uint32_t events, void *tag) {
+        epoll_event event{};
+        event.events   = events;
+        event.data.ptr = tag;
+        if (::epoll_ctl(reactor.epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            throw std::runtime_error("Cannot watch socket");
+        }
+    }
+
+    // reads while the client keeps sending, but stops once the client has
+    // too many responses waiting
+    static std::uint32_t wantedEvents(const Connection &connection) {
+        std::uint32_t events = 0;
+        if (connection.pendingOutput() < kMaxPendingOutput) events |= EPOLLIN;
+        if (connection.pendingOutput() > 0) events |= EPOLLOUT;
+        return events;
+    }
+
+    void acceptAll(Reactor &reactor) {
+        while (true) {
+            int fd = ::accept4(reactor.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;     // EAGAIN, or a connection reset before we got to it
+            int on = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+            auto connection = std::make_unique<Connection>();
+            connection->fd       = fd;
+            connection->interest = EPOLLIN;
+            watch(reactor, fd, EPOLLIN, connection.get());
+            reactor.connections.emplace(fd, std::move(connection));
+        }
+    }
+
+    void close(Reactor &reactor, Connection &connection) {
+        int fd = connection.fd;
+        ::close(fd);                // also leaves the epoll set
+        reactor.connections.erase(fd);
+    }
+
+    // answers every complete request at the front of the input buffer;
+    // false if the client sent something that is not a request
+    bool answer(Reactor &reactor, Connection &connection) {
+        using RequestHeader = WireProtocol::RequestHeader;
+        using Response      = WireProtocol::Response;
+
+        const char *data = connection.in.data();
+        std::size_t used = connection.inUsed;
+        std::size_t pos  = 0;
+        std::size_t answered = 0;
+        while (used - pos >= sizeof(RequestHeader)) {
+            RequestHeader header;
+            std::memcpy(&header, data + pos, sizeof(header));
+            std::size_t frame = std::size_t{2} + header.length;
+            if (frame != sizeof(header) + header.fromLength + header.toLength) return false;
+            if (used - pos < frame) break;
+
+            std::string from(data + pos + sizeof(header), header.fromLength);
+            std::string to(data + pos + sizeof(header) + header.fromLength, header.toLength);
+            for (char &c : from) c = static_cast<char>(toupper(c));
+            for (char &c : to) c = static_cast<char>(toupper(c));
+            // anything but a finite number, in or out, is refused on the wire
+            Result<double> result = std::isfinite(header.amount)
+                                        ? converter.tryConvert(from, to, header.amount)
+                                        : Result<double>(ConversionError::AmountOutOfRange);
+            if (result && !std::isfinite(result.value())) result = ConversionError::AmountOutOfRange;
+
+            Response response{};
+            response.length = static_cast<std::uint16_t>(sizeof(response) - 2);
+            response.status = static_cast<std::uint8_t>(result.error());
+            response.tag    = header.tag;
+            response.value  = result ? result.value() : 0.0;
+            const char *bytes = reinterpret_cast<const char *>(&response);
+            connection.out.insert(connection.out.end(), bytes, bytes + sizeof(response));
+
+            pos += frame;
+            ++answered;
+        }
+
+        std::memmove(connection.in.data(), data + pos, used - pos);
+        connection.inUsed = used - pos;
+        reactor.served.store(reactor.served.load(std::memory_order_relaxed) + answered,
+                             std::memory_order_relaxed);
+        return true;
+    }
+
+    // false if the connection was closed
+    bool receive(Reactor &reactor, Connection &connection) {
+        while (connection.pendingOutput() < kMaxPendingOutput) {
+            std::size_t space = connection.in.size() - connection.inUsed;
+            ssize_t got = ::recv(connection.fd, connection.in.data() + connection.inUsed, space, 0);
+            if (got == 0) return false;
+            if (got < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+            connection.inUsed += static_cast<std::size_t>(got);
+            if (!answer(reactor, connection)) return false;
+            // a short read means the socket is (very likely) empty; epoll
+            // reports it again if not, which saves a recv ending in EAGAIN
+            if (static_cast<std::size_t>(got) < space) break;
+        }
+        return true;
+    }
+
+    // false if the connection was closed
+    static bool send(Connection &connection) {
+        while (connection.pendingOutput() > 0) {
+            ssize_t sent = ::send(connection.fd, connection.out.data() + connection.outSent,
+                                  connection.pendingOutput(), MSG_NOSIGNAL);
+            if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            connection.outSent += static_cast<std::size_t>(sent);
+        }
+        connection.out.clear();
+        connection.outSent = 0;
+        return true;
+    }
+
+    void serve(Reactor &reactor, Connection &connection, std::uint32_t events) {
+        bool open = true;
+        if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) open = receive(reactor, connection);
+        if (open) open = send(connection);
+        if (!open) {
+            close(reactor, connection);
+            return;
+        }
+
+        std::uint32_t wanted = wantedEvents(connection);
+        if (wanted != connection.interest) {
+            epoll_event event{};
+            event.events   = wanted;
+            event.data.ptr = &connection;
+            ::epoll_ctl(reactor.epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.interest = wanted;
+        }
+    }
+
+    void runReactor(Reactor &reactor) {
+        epoll_event events[kMaxEvents];
+        bool running = true;
+        while (running) {
+            int ready = ::epoll_wait(reactor.epollFd, events, kMaxEvents, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            for (int i = 0; i < ready; ++i) {
+                void *tag = events[i].data.ptr;
+                if (tag == nullptr) {
+                    acceptAll(reactor);
+                } else if (tag == &reactor) {
+                    running = false;
+                } else {
+                    serve(reactor, *static_cast<Connection *>(tag), events[i].events);
+                }
+            }
+        }
+        for (auto &entry : reactor.connections) ::close(entry.first);
+        reactor.connections.clear();
+    }
+
+public:
+    // Starts listening on host:port (0 picks a free port) with one reactor
+    // per core unless reactorCount says otherwise.
+    ConversionServer(const CurrencyConverter &conv, const std::string &address,
+                     std::uint16_t listenPort, unsigned reactorCount = 0)
+        : converter(conv), host(address), port(listenPort) {
+        if (reactorCount == 0) reactorCount = std::max(1u, std::thread::hardware_concurrency());
+        try {
+            for (unsigned i = 0; i < reactorCount; ++i) {
+                reactors.push_back(std::make_unique<Reactor>());
+                Reactor &reactor = *reactors.back();
+                reactor.listenFd = openListener(port);
+                if (port == 0) {
+                    // the other reactors join the port the kernel picked
+                    sockaddr_in bound{};
+                    socklen_t length = sizeof(bound);
+                    ::getsockname(reactor.listenFd, reinterpret_cast<sockaddr *>(&bound), &length);
+                    port = ntohs(bound.sin_port);
+                }
+                reactor.epollFd = ::epoll_create1(EPOLL_CLOEXEC);
+                reactor.wakeFd  = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (reactor.epollFd < 0 || reactor.wakeFd < 0) {
+                    throw std::runtime_error("Cannot create event loop");
+                }
+                watch(reactor, reactor.listenFd, EPOLLIN, nullptr);
+                watch(reactor, reactor.wakeFd, EPOLLIN, &reactor);
+            }
+            for (auto &reactor : reactors) {
+                Reactor *r = reactor.get();
+                r->thread = std::thread([this, r] { runReactor(*r); });
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+    }
+
+    ~ConversionServer() { stop(); }
+
+    ConversionServer(const ConversionServer &) = delete;
+    ConversionServer &operator=(const ConversionServer &) = delete;
+
+    std::uint16_t getPort() const { return port; }
+    std::size_t getReactorCount() const { return reactors.size(); }
+
+    // requests answered so far, across all reactors
+    std::uint64_t getServedCount() const {
+        std::uint64_t total = 0;
+        for (const auto &reactor : reactors) {
+            total += reactor->served.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    // closes every connection and joins the reactors; safe to call twice
+    void stop() {
+        if (stopped.exchange(true)) return;
+        for (auto &reactor : reactors) {
+            if (reactor->thread.joinable()) {
+                std::uint64_t one = 1;
+                ssize_t written = ::write(reactor->wakeFd, &one, sizeof(one));
+                (void)written;
+                reactor->thread.join();
+            }
+            for (int fd : {reactor->listenFd, reactor->epollFd, reactor->wakeFd}) {
+                if (fd >= 0) ::close(fd);
+            }
+        }
+    }
+};
+
+struct LoadOptions {
+    std::string host = "127.0.0.1";
+    std::uint16_t port = 0;
+    unsigned connections = std::max(1u, std::thread::hardware_concurrency());
+    unsigned pipeline = 64;             // requests in flight per connection
+    double seconds = 5.0;
+    std::vector<std::string> codes = {"USD", "EUR", "INR", "GBP", "JPY", "AUD", "CAD"};
+};
+
+struct LoadReport {
+    std::uint64_t requests = 0;
+    std::uint64_t failures = 0;         // responses with a non-OK status
+    double seconds = 0.0;
+    double requestsPerSec = 0.0;
+    double p50Us = 0.0, p99Us = 0.0;    // round trip of one pipelined window
+};
+
+// Load generator for ConversionServer: one thread per connection, each
+// sending a window of `pipeline` requests, then reading the window's
+// responses, until the time is up.
+class LoadGenerator {
+    using Clock = std::chrono::steady_clock;
+
+    static bool sendAll(int fd, const char *data, std::size_t length) {
+        while (length > 0) {
+            ssize_t sent = ::send(fd, data, length, MSG_NOSIGNAL);
+            if (sent <= 0) return false;
+            data += sent;
+            length -= static_cast<std::size_t>(sent);
+        }
+        return true;
+    }
+
+    static bool receiveAll(int fd, char *data, std::size_t length) {
+        while (length > 0) {
+            ssize_t got = ::recv(fd, data, length, 0);
+            if (got <= 0) return false;
+            data += got;
+            length -= static_cast<std::size_t>(got);
+        }
+        return true;
+    }
+
+    static int connectTo(const LoadOptions &options) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port   = htons(options.port);
+        if (::inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+            throw std::invalid_argument("Not an IPv4 address: " + options.host);
+        }
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw std::runtime_error("Cannot create socket");
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot connect to " + options.host + ":" +
+                                     std::to_string(options.port));
+        }
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return fd;
+    }
+
+public:
+    static LoadReport run(const LoadOptions &options) {
+        if (options.connections == 0 || options.pipeline == 0 || options.codes.size() < 2) {
+            throw std::invalid_argument("Load needs a connection, a window and two currencies");
+        }
+
+        std::vector<int> sockets;
+        try {
+            for (unsigned c = 0; c < options.connections; ++c) sockets.push_back(connectTo(options));
+        } catch (...) {
+            for (int fd : sockets) ::close(fd);
+            throw;
+        }
+
+        struct alignas(64) Tally {
+            std::uint64_t requests = 0;
+            std::uint64_t failures = 0;
+            std::vector<double> windowUs;
+            bool broken = false;
+        };
+        std::vector<Tally> tallies(options.connections);
+        Clock::time_point start    = Clock::now();
+        Clock::time_point deadline = start + std::chrono::duration_cast<Clock::duration>(
+                                                 std::chrono::duration<double>(options.seconds));
+
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < options.connections; ++c) {
+            threads.emplace_back([&, c] {
+                Tally &tally = tallies[c];
+                std::size_t codeCount = options.codes.size();
+                std::vector<char> window(options.pipeline * WireProtocol::kMaxRequest);
+                std::size_t windowBytes = 0;
+                for (unsigned i = 0; i < options.pipeline; ++i) {
+                    std::size_t k = c + i;
+                    const std::string &from = options.codes[k % codeCount];
+                    const std::string &to   = options.codes[(k / codeCount + k + 1) % codeCount];
+                    windowBytes += WireProtocol::encodeRequest(window.data() + windowBytes, from, to,
+                                                               100.0 + i, i);
+                }
+                std::vector<WireProtocol::Response> responses(options.pipeline);
+                char *responseBytes = reinterpret_cast<char *>(responses.data());
+
+                while (Clock::now() < deadline) {
+                    Clock::time_point sent = Clock::now();
+                    if (!sendAll(sockets[c], window.data(), windowBytes) ||
+                        !receiveAll(sockets[c], responseBytes,
+                                    responses.size() * sizeof(WireProtocol::Response))) {
+                        tally.broken = true;
+                        return;
+                    }
+                    tally.windowUs.push_back(
+                        std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+                    for (unsigned i = 0; i < options.pipeline; ++i) {
+                        if (responses[i].tag != i) {
+                            tally.broken = true;
+                            return;
+                        }
+                        tally.failures += responses[i].status != 0;
+                    }
+                    tally.requests += options.pipeline;
+                }
+            });
+        }
+        for (std::thread &thread : threads) thread.join();
+        for (int fd : sockets) ::close(fd);
+
+        LoadReport report;
+        report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::vector<double> windows;
+        for (const Tally &tally : tallies) {
+            if (tally.broken) throw std::runtime_error("Server closed the connection or answered out of order");
+            report.requests += tally.requests;
+            report.failures += tally.failures;
+            windows.insert(windows.end(), tally.windowUs.begin(), tally.windowUs.end());
+        }
+        report.requestsPerSec = static_cast<double>(report.requests) / report.seconds;
+        if (!windows.empty()) {
+            std::sort(windows.begin(), windows.end());
+            report.p50Us = windows[(windows.size() - 1) / 2];
+            report.p99Us = windows[(windows.size() - 1) * 99 / 100];
+        }
+        return report;
+    }
+};
+
+#endif  // CURRENCY_CONVERTER_EPOLL
+
+// ------------------------ Presentation / UI Layer ------------------------
+
+// Accumulates output and hands it to the FILE in large blocks; nothing is
+// flushed per line.
+class OutputBuffer {
+    std::FILE *file;
+    std::vector<char> data;
+    std::size_t used = 0;
+
+public:
+    explicit OutputBuffer(std::FILE *f, std::size_t capacity = 1 << 16)
+        : file(f), data(capacity) {}
+
+    ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void append(const char *text, std::size_t length) {
+        if (used + length > data.size()) {
+            flush();
+            if (length > data.size()) {
+                std::fwrite(text, 1, length, file);
+                return;
+            }
+        }
+        std::memcpy(data.data() + used, text, length);
+        used += length;
+    }
+
+    void append(const std::string &text) { append(text.data(), text.size()); }
+    void append(char c) { append(&c, 1); }
+
+    void appendFixed(double value, int precision) {
+        char digits[AmountText::kMaxFixedLength];
+        append(digits, static_cast<std::size_t>(AmountText::formatFixed(digits, value, precision) - digits));
+    }
+
+    void flush() {
+        if (used > 0) {
+            std::fwrite(data.data(), 1, used, file);
+            used = 0;
+        }
+    }
+};
+
+struct PipelineReport {
+    std::size_t rows = 0;          // data rows, header and blank lines excluded
+    std::size_t failures = 0;      // rows written with an error instead of a value
+    std::size_t inputBytes = 0;
+    double seconds = 0.0;
+};
+
+// Converts a CSV file of "id,from,to,amount" rows, appending a "converted"
+// column (the amount in `to`, or "error: <reason>"). The input is mapped
+// and cut into line-aligned chunks; worker threads claim chunks in order
+// from a shared counter, parse each into columns, convert them with one
+// convertBatch call and format the rows into the chunk's own buffer. Runs
+// of finished chunks are written in input order with writev. A worker may
+// run at most kWindowPerThread chunks ahead of the writer, which bounds
+// memory for inputs of any size.
+class CsvPipeline {
+public:
+    static constexpr std::size_t kDefaultChunkBytes = std::size_t{4} << 20;
+    static constexpr std::size_t kWindowPerThread = 4;
+
+private:
+    struct Slot {
+        std::vector<char> text;
+        bool ready = false;
+    };
+
+    // Hands finished chunks to the output in input order. Whichever worker
+    // finishes the chunk the output is waiting for writes every ready chunk
+    // from there on; the rest just leave their text in the slot.
+    class OrderedOutput {
+        std::FILE *file;
+        std::vector<Slot> slots;    // chunk k lives in slots[k % size]
+        std::mutex mutex;
+        std::condition_variable advanced;
+        std::size_t nextToWrite = 0;
+        bool writing = false;
+        bool aborted = false;
+
+        void write(std::vector<std::vector<char>> &texts) {
+#ifdef CURRENCY_CONVERTER_POSIX
+            std::vector<iovec> pieces;
+            for (std::vector<char> &text : texts) {
+                if (!text.empty()) pieces.push_back({text.data(), text.size()});
+            }
+            std::size_t first = 0;
+            while (first < pieces.size()) {
+                int count = static_cast<int>(std::min<std::size_t>(pieces.size() - first, IOV_MAX));
+                ssize_t written = ::writev(::fileno(file), pieces.data() + first, count);
+                if (written < 0) {
+                    if (errno == EINTR) continue;
+                    throw std::runtime_error("Cannot write converted rows");
+                }
+                // skip what was written, trimming a piece written in part
+                auto left = static_cast<std::size_t>(written);
+                while (first < pieces.size() && left >= pieces[first].iov_len) {
+                    left -= pieces[first++].iov_len;
+                }
+                if (left > 0) {
+                    pieces[first].iov_base = static_cast<char *>(pieces[first].iov_base) + left;
+                    pieces[first].iov_len -= left;
+                }
+            }
+#else
+            for (const std::vector<char> &text : texts) {
+                if (std::fwrite(text.data(), 1, text.size(), file) != text.size()) {
+                    throw std::runtime_error("Cannot write converted rows");
+                }
+            }
+#endif
+        }
+
+    public:
+        OrderedOutput(std::FILE *out, std::size_t window) : file(out), slots(window) {
+            std::fflush(file);      // anything already buffered goes first
+        }
+
+        // false if the run was aborted while waiting
+        bool waitForSlot(std::size_t chunk) {
+            std::unique_lock<std::mutex> lock(mutex);
+            advanced.wait(lock, [&] { return chunk < nextToWrite + slots.size() || aborted; });
+            return !aborted;
+        }
+
+        void finish(std::size_t chunk, std::vector<char> &&text) {
+            std::unique_lock<std::mutex> lock(mutex);
+            Slot &slot = slots[chunk % slots.size()];
+            slot.text  = std::move(text);
+            slot.ready = true;
+            if (writing) return;
+
+            writing = true;
+            try {
+                while (!aborted && slots[nextToWrite % slots.size()].ready) {
+                    std::vector<std::vector<char>> run;
+                    std::size_t first = nextToWrite;
+                    while (run.size() < slots.size() && slots[(first + run.size()) % slots.size()].ready) {
+                        run.push_back(std::move(slots[(first + run.size()) % slots.size()].text));
+                    }
+                    lock.unlock();
+                    write(run);
+                    lock.lock();
+                    for (std::size_t i = 0; i < run.size(); ++i) {
+                        slots[(first + i) % slots.size()].ready = false;
+                    }
+                    nextToWrite += run.size();
+                    advanced.notify_all();
+                }
+            } catch (...) {
+                if (!lock.owns_lock()) lock.lock();
+                writing = false;
+                throw;
+            }
+            writing = false;
+        }
+
+        void abort() {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+            advanced.notify_all();
+        }
+    };
+
+    static constexpr std::size_t kCacheSlots = 256;
+
+    // per-thread parse state, reused from chunk to chunk
+    struct Worker {
+        // direct-mapped caches; a colliding key just replaces the entry
+        struct CodeEntry { std::uint64_t packed = 0; CurrencyId id = kInvalidCurrencyId; };
+        struct PairEntry {
+            std::uint64_t key = ~std::uint64_t{0};
+            bool supported = false;
+            std::uint8_t decimals = 2;        // minor units of the target
+        };
+        CodeEntry codes[kCacheSlots];         // upper-cased code, up to 8 bytes packed
+        PairEntry pairs[kCacheSlots];         // pairKey -> has a rate; cleared per chunk
+        std::vector<CurrencyPair> rowPairs;
+        std::vector<double> amounts, converted;
+        std::vector<std::uint8_t> decimals;   // per converted row
+        std::vector<std::uint8_t> status;                       // per line; see kMalformed
+        std::vector<std::pair<const char *, std::size_t>> lines;
+        std::size_t rows = 0, failures = 0;
+    };
+
+    static constexpr std::uint8_t kBlank = 0xFE;      // line status: written as is (header) or dropped
+    static constexpr std::uint8_t kMalformed = 0xFF;  // otherwise a ConversionError
+    static constexpr std::size_t kMaxSuffix = AmountText::kMaxFixedLength + 64;  // ",<value or error>\n"
+
+    // start of the first line that begins at or after offset
+    static std::size_t lineStartAtOrAfter(const char *data, std::size_t size, std::size_t offset) {
+        if (offset == 0 || offset >= size) return std::min(offset, size);
+        const void *newline = std::memchr(data + offset - 1, '\n', size - offset + 1);
+        return newline ? static_cast<std::size_t>(static_cast<const char *>(newline) - data) + 1 : size;
+    }
+
+    static std::size_t cacheSlot(std::uint64_t key) {
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 56) & (kCacheSlots - 1);
+    }
+
+    template <typename Converter>
+    static CurrencyId resolve(const Converter &conv, Worker &worker, const char *text, std::size_t length) {
+        char code[8] = {};
+        if (length == 0 || length > sizeof(code)) {
+            std::string longCode(text, length);
+            for (char &c : longCode) c = static_cast<char>(toupper(c));
+            return conv.findCurrency(longCode);
+        }
+        for (std::size_t i = 0; i < length; ++i) code[i] = static_cast<char>(toupper(text[i]));
+        std::uint64_t packed;
+        std::memcpy(&packed, code, sizeof(packed));
+
+        Worker::CodeEntry &entry = worker.codes[cacheSlot(packed)];
+        if (entry.packed != packed) {
+            entry.packed = packed;
+            entry.id     = conv.findCurrency(std::string(code, length));
+        }
+        return entry.id;
+    }
+
+    // Parses, converts and formats the lines in [first, last) into text.
+    template <typename Converter>
+    static void convertChunk(const Converter &conv, Worker &worker, const char *first, const char *last,
+                             bool startsFile, std::vector<char> &text) {
+        worker.rowPairs.clear();
+        worker.amounts.clear();
+        worker.decimals.clear();
+        worker.status.clear();
+        worker.lines.clear();
+        for (Worker::PairEntry &entry : worker.pairs) entry = {};  // rates may have changed
+
+        for (const char *line = first; line < last;) {
+            const char *newline = static_cast<const char *>(
+                std::memchr(line, '\n', static_cast<std::size_t>(last - line)));
+            const char *end  = newline ? newline : last;
+            const char *next = newline ? newline + 1 : last;
+            if (end > line && end[-1] == '\r') --end;
+            worker.lines.emplace_back(line, static_cast<std::size_t>(end - line));
+
+            const char *fields[4];
+            std::size_t lengths[4];
+            std::size_t count = 0;   // fields on the line, counted up to 5
+            for (const char *field = line;;) {
+                const char *comma = static_cast<const char *>(
+                    std::memchr(field, ',', static_cast<std::size_t>(end - field)));
+                if (count < 4) {
+                    fields[count]  = field;
+                    lengths[count] = static_cast<std::size_t>((comma ? comma : end) - field);
+                }
+                if (!comma || ++count > 4) break;
+                field = comma + 1;
+            }
+            ++count;
+
+            double amount = 0.0;
+            bool isHeader = startsFile && line == first && end - line >= 3 &&
+                            std::memcmp(line, "id,", 3) == 0;
+            if (end == line || isHeader) {
+                worker.status.push_back(kBlank);
+            } else if (count != 4 || lengths[3] == 0 ||
+                       !AmountText::parse(fields[3], fields[3] + lengths[3], amount)) {
+                worker.status.push_back(kMalformed);
+            } else {
+                CurrencyPair pair{resolve(conv, worker, fields[1], lengths[1]),
+                                  resolve(conv, worker, fields[2], lengths[2])};
+                std::uint64_t key = pairKey(pair.from, pair.to);
+                Worker::PairEntry &known = worker.pairs[cacheSlot(key)];
+                if (known.key != key) {
+                    known.key       = key;
+                    known.supported = conv.tryConvert(pair.from, pair.to, 1.0).ok();
+                    known.decimals  = static_cast<std::uint8_t>(
+                        std::min(conv.getMinorUnits(pair.to), AmountText::kMaxDecimals));
+                }
+                if (known.supported) {
+                    worker.status.push_back(static_cast<std::uint8_t>(ConversionError::None));
+                    worker.rowPairs.push_back(pair);
+                    worker.amounts.push_back(amount);
+                    worker.decimals.push_back(known.decimals);
+                } else {
+                    worker.status.push_back(static_cast<std::uint8_t>(ConversionError::UnsupportedCurrency));
+                }
+            }
+            line = next;
+        }
+
+        worker.converted.resize(worker.amounts.size());
+        conv.convertBatch(worker.rowPairs.data(), worker.amounts.data(), worker.converted.data(),
+                          worker.amounts.size());   // negative rows come back as NaN
+
+        // room for the input plus a typical converted value per row; rows
+        // that need more (long errors, huge values) grow it as they go
+        text.resize(static_cast<std::size_t>(last - first) + worker.lines.size() * 16);
+        char *cursor = text.data();
+        auto reserve = [&](std::size_t bytes) {
+            std::size_t used = static_cast<std::size_t>(cursor - text.data());
+            if (text.size() - used < bytes) {
+                text.resize(std::max(text.size() * 2, used + bytes));
+                cursor = text.data() + used;
+            }
+        };
+        auto append = [&cursor](const char *bytes, std::size_t length) {
+            std::memcpy(cursor, bytes, length);
+            cursor += length;
+        };
+
+        std::size_t converted = 0;
+        for (std::size_t i = 0; i < worker.lines.size(); ++i) {
+            const auto &line = worker.lines[i];
+            std::uint8_t status = worker.status[i];
+            reserve(line.second + kMaxSuffix);
+            if (status == kBlank) {
+                if (line.second == 0) continue;
+                append(line.first, line.second);
+                append(",converted\n", 11);
+                continue;
+            }
+
+            ++worker.rows;
+            append(line.first, line.second);
+            *cursor++ = ',';
+            const char *error = nullptr;
+            if (status == kMalformed) {
+                error = "expected id,from,to,amount";
+            } else if (status != static_cast<std::uint8_t>(ConversionError::None)) {
+                error = describe(static_cast<ConversionError>(status));
+            } else if (std::isnan(worker.converted[converted])) {
+                error = describe(ConversionError::NegativeAmount);
+                ++converted;
+            } else {
+                cursor = AmountText::formatFixed(cursor, worker.converted[converted],
+                                                 worker.decimals[converted]);
+                ++converted;
+            }
+            if (error) {
+                ++worker.failures;
+                append("error: ", 7);
+                append(error, std::strlen(error));
+            }
+            *cursor++ = '\n';
+        }
+        text.resize(static_cast<std::size_t>(cursor - text.data()));
+    }
+
+public:
+    // Converts inputPath to out with the given number of threads (0: one
+    // per core). Throws if the input cannot be read or the output written.
+    template <typename Converter>
+    static PipelineReport run(const Converter &conv, const std::string &inputPath, std::FILE *out,
+                              unsigned threads = 0, std::size_t chunkBytes = kDefaultChunkBytes) {
+        auto start = std::chrono::steady_clock::now();
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        chunkBytes = std::max<std::size_t>(chunkBytes, 1);
+
+        MappedFile input(inputPath);
+        const char *data = reinterpret_cast<const char *>(input.data());
+        std::size_t size = input.size();
+        std::size_t chunkCount = (size + chunkBytes - 1) / chunkBytes;
+
+        OrderedOutput output(out, std::size_t{threads} * kWindowPerThread);
+        std::atomic<std::size_t> nextChunk{0};
+        std::vector<Worker> workers(threads);
+        std::mutex errorMutex;
+        std::exception_ptr error;
+
+        auto work = [&](Worker &worker) {
+            try {
+                std::vector<char> text;
+                while (true) {
+                    std::size_t chunk = nextChunk.fetch_add(1, std::memory_order_relaxed);
+                    if (chunk >= chunkCount || !output.waitForSlot(chunk)) return;
+                    std::size_t first = lineStartAtOrAfter(data, size, chunk * chunkBytes);
+                    std::size_t last  = lineStartAtOrAfter(data, size, (chunk + 1) * chunkBytes);
+                    convertChunk(conv, worker, data + first, data + last, chunk == 0, text);
+                    output.finish(chunk, std::move(text));
+                    text = std::vector<char>();
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                output.abort();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) {
+            pool.emplace_back(work, std::ref(workers[t]));
+        }
+        work(workers[0]);
+        for (std::thread &thread : pool) thread.join();
+        if (error) std::rethrow_exception(error);
+
+        PipelineReport report;
+        for (const Worker &worker : workers) {
+            report.rows += worker.rows;
+            report.failures += worker.failures;
+        }
+        report.inputBytes = size;
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return report;
+    }
+};
+
+class ConverterApp {
+    std::unique_ptr<RateLog> wal;          // optional; outlives the provider using it
+#ifdef CURRENCY_CONVERTER_POSIX
+    std::unique_ptr<SharedRateBook> sharedBook;   // optional, likewise
+#endif
+    StaticRateProvider rateProvider;
+    TriangulatingRateProvider rateGraph;   // follows chains of custom rates
+    QuoteCache<TriangulatingRateProvider> quotes;
+    BasicCurrencyConverter<QuoteCache<TriangulatingRateProvider>> converter;
+    CurrencyTable currencies;               // names and symbols for display
+
+public:
+    ConverterApp()
+        : rateProvider("USD"), rateGraph(rateProvider), quotes(rateGraph), converter(quotes) {
+        rateProvider.enableCrossRateMatrix();
+        seedCurrencies();
+    }
+
+    void run() {
+        bool running = true;
+        while (running) {
+            printMainMenu();
+            int choice = readInt("Choose an option: ");
+            std::cout << "\n";
+
+            try {
+                switch (choice) {
+                    case 1:
+                        handleConvert();
+                        break;
+                    case 2:
+                        handleListCurrencies();
+                        break;
+                    case 3:
+                        handleCustomRate();
+                        break;
+                    case 4:
+                        printAbout();
+                        break;
+                    case 0:
+                        running = false;
+                        break;
+                    default:
+                        std::cout << "Unknown choice. Try again.\n";
+                }
+            } catch (const std::exception &ex) {
+                std::cout << "Error: " << ex.what() << "\n";
+            }
+
+            if (running) {
+                std::cout << "\nPress ENTER to continue...";
+                std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                std::cin.get();
+                std::cout << "\n";
+            }
+        }
+
+        std::cout << "Goodbye!" << std::endl;
+    }
+
+    // Headless mode: reads "FROM TO AMOUNT" lines from in and writes one line
+    // per request to out ("10.00 USD = 831.00 INR", or "error: <reason>").
+    // Blank lines are skipped. Returns the number of requests that failed.
+    std::size_t runBatch(std::FILE *in, std::FILE *out) { return runBatch(in, out, converter); }
+
+    // Converts a CSV file of "id,from,to,amount" rows; see CsvPipeline.
+    PipelineReport convertCsv(const std::string &path, std::FILE *out, unsigned threads) const {
+        return CsvPipeline::run(converter, path, out, threads);
+    }
+
+    // same, with any converter (e.g. one over a SharedRateProvider)
+    template <typename Converter>
+    static std::size_t runBatch(std::FILE *in, std::FILE *out, const Converter &conv) {
+        OutputBuffer output(out);
+        std::vector<char> buffer(1 << 16);
+        std::size_t carried = 0;   // bytes of an unfinished line kept from the last read
+        std::size_t failures = 0;
+
+        while (true) {
+            std::size_t read = std::fread(buffer.data() + carried, 1, buffer.size() - carried, in);
+            std::size_t end = carried + read;
+
+            const char *lineStart = buffer.data();
+            const char *dataEnd   = buffer.data() + end;
+            while (const char *newline = static_cast<const char *>(
+                       std::memchr(lineStart, '\n', static_cast<std::size_t>(dataEnd - lineStart)))) {
+                failures += convertLine(conv, lineStart, newline, output) ? 0 : 1;
+                lineStart = newline + 1;
+            }
+
+            if (read == 0) {
+                if (lineStart != dataEnd) {
+                    failures += convertLine(conv, lineStart, dataEnd, output) ? 0 : 1;
+                }
+                break;
+            }
+
+            carried = static_cast<std::size_t>(dataEnd - lineStart);
+            std::memmove(buffer.data(), lineStart, carried);
+            if (carried == buffer.size()) {
+                buffer.resize(buffer.size() * 2);  // one very long line
+            }
+        }
+        return failures;
+    }
+
+private:
+    static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static const char *nextToken(const char *&cursor, const char *last, std::size_t &length) {
+        while (cursor != last && isBlank(*cursor)) ++cursor;
+        const char *start = cursor;
+        while (cursor != last && !isBlank(*cursor)) ++cursor;
+        length = static_cast<std::size_t>(cursor - start);
+        return start;
+    }
+
+    // false if the line was a request that could not be converted
+    template <typename Converter>
+    static bool convertLine(const Converter &conv, const char *first, const char *last,
+                            OutputBuffer &output) {
+        std::size_t fromLength, toLength, amountLength, extraLength;
+        const char *cursor     = first;
+        const char *fromToken  = nextToken(cursor, last, fromLength);
+        const char *toToken    = nextToken(cursor, last, toLength);
+        const char *amountText = nextToken(cursor, last, amountLength);
+        nextToken(cursor, last, extraLength);
+
+        if (fromLength == 0) return true;  // blank line
+
+        double amount = 0.0;
+        if (toLength == 0 || extraLength != 0 ||
+            !AmountText::parse(amountText, amountText + amountLength, amount)) {
+            output.append("error: expected FROM TO AMOUNT\n");
+            return false;
+        }
+
+        std::string from(fromToken, fromLength);
+        std::string to(toToken, toLength);
+        for (char &c : from) c = static_cast<char>(toupper(c));
+        for (char &c : to) c = static_cast<char>(toupper(c));
+
+        Result<double> result = conv.tryConvert(from, to, amount);
+        if (!result) {
+            output.append("error: ");
+            output.append(describe(result.error()));
+            output.append('\n');
+            return false;
+        }
+
+        // each side with its own currency's decimals ("2.50 EUR = 385 JPY")
+        output.appendFixed(amount, conv.getMinorUnits(conv.findCurrency(from)));
+        output.append(' ');
+        output.append(from);
+        output.append(" = ");
+        output.appendFixed(result.value(), conv.getMinorUnits(conv.findCurrency(to)));
+        output.append(' ');
+        output.append(to);
+        output.append('\n');
+        return true;
+    }
+
+    static int readInt(const std::string &prompt) {
+        int value;
+        while (true) {
+            std::cout << prompt;
+            if (std::cin >> value) {
+                return value;
+            }
+            std::cout << "Invalid number. Try again.\n";
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+    }
+
+    static double readDouble(const std::string &prompt) {
+        std::string text;
+        double value;
+        while (true) {
+            std::cout << prompt;
+            if (std::cin >> text && AmountText::parse(text, value)) {
+                return value;
+            }
+            std::cout << "Invalid number. Try again.\n";
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+    }
+
+    static std::string readCode(const std::string &prompt) {
+        std::string code;
+        std::cout << prompt;
+        std::cin >> code;
+        for (char &c : code) c = static_cast<char>(toupper(c));
+        return code;
+    }
+
+    void seedCurrencies() {
+        // Names come from the ISO 4217 table; symbols are not part of it.
+        // In a larger system, this could be loaded from a database or config file
+        static constexpr std::pair<const char *, const char *> kSymbols[] = {
+            {"USD", "$"}, {"EUR", "€"}, {"INR", "₹"}, {"GBP", "£"},
+            {"JPY", "¥"}, {"AUD", "$"}, {"CAD", "$"},
+        };
+        for (const auto &entry : kSymbols) {
+            registerCurrency({entry.first, Iso4217::find(entry.first)->name, entry.second});
+        }
+    }
+
+    void registerCurrency(const Currency &currency) {
+        currencies.add(currency);
+    }
+
+public:
+    // Replaces the built-in rates and currency list with a rate book file.
+    void loadRateBook(const std::string &path) {
+        RateBookFile file(path);
+        rateProvider.loadRateBook(file);
+        rateGraph.resync();
+
+        currencies.clear();
+        const RateBookFile::CurrencyRecord *records = file.currencies();
+        for (std::size_t i = 0; i < file.currencyCount(); ++i) {
+            const RateBookFile::CurrencyRecord &r = records[i];
+            if (r.rateVsBase != 0.0) {
+                registerCurrency({RateBookFile::fieldText(r.code, sizeof(r.code)),
+                                  RateBookFile::fieldText(r.name, sizeof(r.name)),
+                                  RateBookFile::fieldText(r.symbol, sizeof(r.symbol))});
+            }
+        }
+    }
+
+    void saveRateBook(const std::string &path) const {
+        rateProvider.writeRateBook(path, currencies);
+    }
+
+    // Restores the rates saved by earlier runs from a write-ahead log, and
+    // logs every later change (custom rates, rate book loads) to it.
+    void openLog(const std::string &path) {
+        wal = std::make_unique<RateLog>(path);
+        rateProvider.attachLog(*wal);
+        rateGraph.resync();
+        for (const std::string &code : rateProvider.getSupportedCodes()) {
+            if (currencies.contains(code)) continue;
+            const IsoCurrency *iso = Iso4217::find(code);
+            registerCurrency({code, iso ? iso->name : code, ""});
+        }
+    }
+
+    // Answers WireProtocol requests on host:port until SIGINT or SIGTERM.
+    void serve(const std::string &host, std::uint16_t port, unsigned reactorCount) {
+        serve(host, port, reactorCount, CurrencyConverter(quotes));
+    }
+
+    // same, with any converter (e.g. one over a SharedRateProvider)
+    static void serve(const std::string &host, std::uint16_t port, unsigned reactorCount,
+                      const CurrencyConverter &conv) {
+#ifdef CURRENCY_CONVERTER_EPOLL
+        // blocked before the reactors start, so they inherit the mask and
+        // the signal is taken here
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+        ConversionServer server(conv, host, port, reactorCount);
+        std::cout << "Serving on " << host << ":" << server.getPort() << " with "
+                  << server.getReactorCount() << " reactor(s). Ctrl+C stops.\n" << std::flush;
+        int received = 0;
+        sigwait(&signals, &received);
+        server.stop();
+        std::cout << "Served " << server.getServedCount() << " requests\n";
+#else
+        (void)host; (void)port; (void)reactorCount; (void)conv;
+        throw std::runtime_error("Server mode needs Linux (epoll)");
+#endif
+    }
+
+    // Publishes the rates to a shared-memory segment for --attach readers,
+    // and keeps it up to date with every later change.
+    void shareRates(const std::string &name) {
+#ifdef CURRENCY_CONVERTER_POSIX
+        sharedBook = std::make_unique<SharedRateBook>(name, 1024, 4096);
+        rateProvider.shareTo(*sharedBook);
+#else
+        (void)name;
+        throw std::runtime_error("Shared rate books need POSIX shared memory");
+#endif
+    }
+
+private:
+
+    void printMainMenu() {
+        std::cout << "==============================\n";
+        std::cout << "   Smart Currency Converter\n";
+        std::cout << "==============================\n";
+        std::cout << "1. Convert amount\n";
+        std::cout << "2. List supported currencies\n";
+        std::cout << "3. Override custom exchange rate\n";
+        std::cout << "4. About this tool\n";
+        std::cout << "0. Exit\n";
+    }
+
+    void handleConvert() {
+        std::cout << "--- Convert Amount ---\n";
+        std::string from = readCode("From currency code (e.g. USD): ");
+        std::string to   = readCode("To currency code (e.g. INR): ");
+        double amount    = readDouble("Amount: ");
+
+        // exact conversion, rounded to each currency's own minor unit
+        CurrencyId fromId = rateProvider.findCurrency(from);
+        CurrencyId toId   = rateProvider.findCurrency(to);
+        int fromUnits     = rateProvider.getMinorUnits(fromId);
+        Money source      = Money::fromDecimal(amount, fromId, fromUnits).valueOrThrow();
+        Money result      = converter.convert(source, toId);
+
+        std::cout << "\n" << source.toString(fromUnits) << " " << from
+                  << " = " << result.toString(rateProvider.getMinorUnits(toId)) << " " << to << "\n";
+    }
+
+    void handleListCurrencies() {
+        std::cout << "--- Supported Currencies ---\n";
+        std::cout << std::left << std::setw(8)  << "Code"
+                  << std::setw(20) << "Name"
+                  << "Symbol" << "\n";
+        std::cout << "-------------------------------------\n";
+        for (CurrencyId row : currencies.byCode()) {
+            Currency c = currencies.get(row);
+            std::cout << std::left << std::setw(8)  << c.getCode()
+                      << std::setw(20) << c.getName()
+                      << c.getSymbol() << "\n";
+        }
+    }
+
+    void handleCustomRate() {
+        std::cout << "--- Custom Exchange Rate ---\n";
+        std::string from = readCode("From currency code: ");
+        std::string to   = readCode("To currency code: ");
+        double rate      = readDouble("Custom rate (1 " + from + " = ? " + to + "): ");
+
+        rateGraph.setCustomRate(from, to, rate);
+        std::cout << "Custom rate updated. Future conversions will use this rate.\n";
+
+        if (auto cycle = rateGraph.lastInconsistency()) {
+            std::shared_ptr<const RateBook> book = rateProvider.snapshot();
+            std::cout << "Warning: custom rates are inconsistent around ";
+            for (std::size_t i = 0; i < cycle->nodes.size(); ++i) {
+                std::cout << (i ? " -> " : "") << book->getCode(cycle->nodes[i]);
+            }
+            std::cout << " (round trip multiplies by " << cycle->product << ")\n";
+        }
+    }
+
+    void printAbout() {
+        std::cout << "--- About ---\n";
+        std::cout << "This demo shows an object-oriented design in C++.\n";
+        std::cout << "Key concepts used:\n";
+        std::cout << " - Encapsulation via Currency, StaticRateProvider, CurrencyConverter classes\n";
+        std::cout << " - Inheritance and polymorphism via ExchangeRateProvider interface\n";
+        std::cout << " - Separation of concerns (domain, application, UI layers)\n";
+    }
+};
+
+// ------------------------ Benchmark Layer ------------------------
+
+struct BenchOptions {
+    std::vector<std::size_t> universes = {7, 100, 1000, 10000};  // currencies registered
+    std::vector<double> hitRatios = {0.0, 0.5, 1.0};  // share of lookups with a custom override
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t opsPerThread = 2000000;
+    std::size_t latencySamples = 200000;              // individually timed ops per thread
+    std::size_t maxMatrixUniverse = 2048;             // larger N x N tables do not fit in memory
+    std::size_t historyTicks = 525600;                // per currency; a year of minute ticks
+    std::size_t repriceRows = 5000000;                // transactions revalued per pass
+    std::size_t walUpdates = 10000000;                // log size for the recovery timing
+    std::string scratchDir = ".";                     // where the log benchmark writes
+    double serverSeconds = 2.0;                       // per loopback server row
+    std::size_t csvRows = 5000000;                    // rows in the pipeline benchmark's file
+};
+
+struct BenchResult {
+    double nsPerOp;     // per-thread cost, throughput loop
+    double opsPerSec;   // all threads combined
+    double p50, p99, p999;  // single-op latency in ns, timer overhead removed
+};
+
+// Measures the conversion hot path. Every row runs a timer-free throughput loop
+// followed by a pass that times single operations for the latency percentiles.
+class BenchmarkSuite {
+    using Clock = std::chrono::steady_clock;
+
+    BenchOptions options;
+    double timerOverheadNs = 0.0;
+
+    static double elapsedNs(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    static double percentile(std::vector<double> &sorted, double p) {
+        if (sorted.empty()) return 0.0;
+        std::size_t index = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1));
+        return sorted[index];
+    }
+
+    static std::string makeCode(std::size_t index) {
+        std::string code(3, 'A');
+        for (int pos = 2; pos >= 0; --pos) {
+            code[pos] = static_cast<char>('A' + index % 26);
+            index /= 26;
+        }
+        return code;
+    }
+
+    void calibrateTimer() {
+        const int rounds = 100000;
+        auto start = Clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            (void)Clock::now();
+        }
+        timerOverheadNs = elapsedNs(start, Clock::now()) / rounds;
+    }
+
+public:
+    explicit BenchmarkSuite(BenchOptions opts = {}) : options(std::move(opts)) {
+        calibrateTimer();
+    }
+
+    const BenchOptions &getOptions() const { return options; }
+
+    std::vector<unsigned> threadCounts() const {
+        std::vector<unsigned> counts;
+        for (unsigned t = 1; t < options.maxThreads; t *= 2) counts.push_back(t);
+        counts.push_back(options.maxThreads);
+        return counts;
+    }
+
+    // Runs op(thread, i) on `threads` threads. op returns a double that is
+    // folded into a sink so the compiler cannot drop the work.
+    template <typename Op>
+    BenchResult measure(unsigned threads, Op op) const {
+        return measure(threads, options.opsPerThread, options.latencySamples, op);
+    }
+
+    template <typename Op>
+    BenchResult measure(unsigned threads, std::size_t opsPerThread, std::size_t latencySamples,
+                        Op op) const {
+        std::atomic<unsigned> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<double> threadNs(threads, 0.0);
+        std::vector<std::vector<double>> latencies(threads);
+        std::atomic<double> sink{0.0};
+
+        auto worker = [&](unsigned t) {
+            std::vector<double> &samples = latencies[t];
+            samples.reserve(latencySamples);
+
+            ready.fetch_add(1);
+            while (!go.load()) std::this_thread::yield();
+
+            double acc = 0.0;
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < opsPerThread; ++i) {
+                acc += op(t, i);
+            }
+            threadNs[t] = elapsedNs(start, Clock::now());
+
+            for (std::size_t i = 0; i < latencySamples; ++i) {
+                auto opStart = Clock::now();
+                acc += op(t, i);
+                double ns = elapsedNs(opStart, Clock::now()) - timerOverheadNs;
+                samples.push_back(std::max(ns, 0.0));
+            }
+            sink.store(acc, std::memory_order_relaxed);
+        };
+
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker, t);
+        while (ready.load() != threads) std::this_thread::yield();
+        go.store(true);
+        for (std::thread &th : pool) th.join();
+
+        std::vector<double> all;
+        for (auto &samples : latencies) all.insert(all.end(), samples.begin(), samples.end());
+        std::sort(all.begin(), all.end());
+
+        double slowestNs = *std::max_element(threadNs.begin(), threadNs.end());
+        double totalOps = static_cast<double>(opsPerThread) * threads;
+
+        BenchResult result;
+        result.nsPerOp   = slowestNs / static_cast<double>(opsPerThread);
+        result.opsPerSec = totalOps / (slowestNs / 1e9);
+        result.p50  = percentile(all, 0.50);
+        result.p99  = percentile(all, 0.99);
+        result.p999 = percentile(all, 0.999);
+        return result;
+    }
+
+    static void printHeader(std::ostream &out) {
+        out << std::left << std::setw(42) << "case" << std::right
+            << std::setw(8) << "threads" << std::setw(10) << "ns/op"
+            << std::setw(14) << "ops/s" << std::setw(9) << "p50"
+            << std::setw(9) << "p99" << std::setw(9) << "p999" << "\n";
+    }
+
+    static void printRow(std::ostream &out, const std::string &label, unsigned threads,
+                         const BenchResult &r) {
+        out << std::left << std::setw(42) << label << std::right << std::fixed
+            << std::setw(8) << threads
+            << std::setw(10) << std::setprecision(2) << r.nsPerOp
+            << std::setw(14) << std::setprecision(0) << r.opsPerSec
+            << std::setw(9) << std::setprecision(1) << r.p50
+            << std::setw(9) << r.p99 << std::setw(9) << r.p999 << "\n";
+    }
+
+    void run(std::ostream &out) {
+        out << "timer overhead " << std::fixed << std::setprecision(1)
+            << timerOverheadNs << " ns (subtracted from latencies)\n";
+        out << "batch kernels: " << BatchKernels::best().name << "\n\n";
+        printHeader(out);
+
+        for (std::size_t universe : options.universes) {
+            runRateLookups(out, universe);
+        }
+        runIsoTable(out);
+        runErrorPath(out);
+        runMoneyPath(out);
+        runAmountText(out);
+        runTriangulation(out);
+        runQuoteCache(out);
+        runSharedBook(out);
+        runBulkUpdate(out);
+        runOverrideWrites(out);
+        runRecovery(out);
+        runHistory(out);
+        runCsvPipeline(out);
+        runServer(out);
+    }
+
+private:
+    // A CSV export converted by a plain single-threaded loop (split the
+    // line, convert, format) and by CsvPipeline at each thread count. The
+    // output goes to the null device, so the rows compare conversion work,
+    // not the disk.
+    void runCsvPipeline(std::ostream &out) {
+        const std::string path = options.scratchDir + "/currency_bench.csv";
+        const char *codes[] = {"USD", "EUR", "INR", "GBP", "JPY", "AUD", "CAD"};
+        std::FILE *csv = std::fopen(path.c_str(), "wb");
+        if (!csv) throw std::runtime_error("Cannot create " + path);
+        {
+            OutputBuffer file(csv);
+            std::mt19937 rng(22);
+            file.append("id,from,to,amount\n");
+            for (std::size_t i = 0; i < options.csvRows; ++i) {
+                file.append(std::to_string(100000000 + i));
+                file.append(',');
+                file.append(codes[rng() % 7]);
+                file.append(',');
+                file.append(codes[rng() % 7]);
+                file.append(',');
+                file.appendFixed(static_cast<double>(rng() % 10000000) / 100.0, 2);
+                file.append('\n');
+            }
+        }
+        std::fclose(csv);
+
+#ifdef CURRENCY_CONVERTER_POSIX
+        std::FILE *sink = std::fopen("/dev/null", "wb");
+#else
+        std::FILE *sink = std::fopen("NUL", "wb");
+#endif
+        StaticRateProvider provider("USD");
+        CurrencyConverter converter(provider);
+
+        Clock::time_point start = Clock::now();
+        std::size_t bytes = 0;
+        {
+            MappedFile input(path);
+            OutputBuffer output(sink);
+            const char *cursor = reinterpret_cast<const char *>(input.data());
+            const char *end    = cursor + input.size();
+            bytes = input.size();
+            cursor = static_cast<const char *>(std::memchr(cursor, '\n', bytes)) + 1;  // header
+            while (cursor < end) {
+                const char *line    = cursor;
+                const char *newline = static_cast<const char *>(
+                    std::memchr(line, '\n', static_cast<std::size_t>(end - line)));
+                cursor = newline + 1;
+                const char *fromText = static_cast<const char *>(std::memchr(line, ',', newline - line)) + 1;
+                const char *toText   = static_cast<const char *>(std::memchr(fromText, ',', newline - fromText)) + 1;
+                const char *amountText = static_cast<const char *>(std::memchr(toText, ',', newline - toText)) + 1;
+                double amount = 0.0;
+                std::from_chars(amountText, newline, amount);
+                Result<double> result = converter.tryConvert(std::string(fromText, toText - 1),
+                                                             std::string(toText, amountText - 1), amount);
+                output.append(line, static_cast<std::size_t>(newline - line));
+                output.append(',');
+                if (result) {
+                    output.appendFixed(result.value(), 2);
+                } else {
+                    output.append("error: ");
+                    output.append(describe(result.error()));
+                }
+                output.append('\n');
+            }
+        }
+        double loopNs = elapsedNs(start, Clock::now());
+        double rows   = static_cast<double>(options.csvRows);
+        out << "csv " << options.csvRows << " rows (" << bytes / (1 << 20) << " MiB): convert loop "
+            << std::setprecision(1) << loopNs / rows << " ns/row ("
+            << std::setprecision(0) << bytes / loopNs * 1e3 << " MB/s)\n";
+
+        for (unsigned threads : threadCounts()) {
+            PipelineReport report = CsvPipeline::run(converter, path, sink, threads);
+            double ns = report.seconds * 1e9;
+            out << "csv pipeline " << threads << " thread(s): " << std::setprecision(1)
+                << ns / rows << " ns/row (" << std::setprecision(0) << bytes / ns * 1e3
+                << " MB/s), " << std::setprecision(1) << loopNs / ns << "x the loop\n";
+        }
+        std::fclose(sink);
+        std::remove(path.c_str());
+    }
+
+    // Conversions per second through ConversionServer on loopback, with and
+    // without pipelining. Client threads share the cores with the reactors.
+    void runServer(std::ostream &out) {
+#ifdef CURRENCY_CONVERTER_EPOLL
+        StaticRateProvider provider("USD");
+        CurrencyConverter converter(provider);
+        unsigned reactors = std::max(1u, options.maxThreads / 2);
+        ConversionServer server(converter, "127.0.0.1", 0, reactors);
+
+        for (unsigned pipeline : {1u, 64u}) {
+            LoadOptions load;
+            load.port        = server.getPort();
+            load.connections = options.maxThreads;
+            load.pipeline    = pipeline;
+            load.seconds     = options.serverSeconds;
+            LoadReport report = LoadGenerator::run(load);
+            out << "loopback server " << reactors << " reactor(s), " << load.connections
+                << " conn x " << pipeline << " in flight: " << std::setprecision(0)
+                << report.requestsPerSec << " req/s, window p50 " << std::setprecision(1)
+                << report.p50Us << " us, p99 " << report.p99Us << " us\n";
+        }
+#else
+        out << "loopback server: skipped (needs Linux epoll)\n";
+#endif
+    }
+
+    // Writes a log of walUpdates custom-rate changes (group-committed every
+    // 4096), then times a restart: replaying the whole log, and mapping a
+    // snapshot after a checkpoint.
+    void runRecovery(std::ostream &out) {
+        const std::string path = options.scratchDir + "/currency_bench.wal";
+        auto cleanUp = [&] {
+            for (const char *suffix : {"", ".snap", ".tmp", ".snap.tmp"}) {
+                std::remove((path + suffix).c_str());
+            }
+        };
+        cleanUp();
+
+        Clock::time_point start = Clock::now();
+        std::uint64_t flushes = 0;
+        {
+            RateLog wal(path, std::numeric_limits<std::size_t>::max());
+            wal.recover();
+            std::mt19937 rng(19);
+            std::uint64_t sequence = 0;
+            for (std::size_t i = 0; i < options.walUpdates; ++i) {
+                RateUpdate change;
+                change.setCustomRate("C" + std::to_string(rng() % 200), "C" + std::to_string(rng() % 200),
+                                     1.0 + static_cast<double>(i % 1000) / 100.0);
+                sequence = wal.append(change);
+                if (sequence % 4096 == 0) wal.waitDurable(sequence);
+            }
+            wal.waitDurable(sequence);
+            flushes = wal.getFlushCount();
+        }
+        Clock::time_point written = Clock::now();
+
+        auto recover = [&] {
+            Clock::time_point begin = Clock::now();
+            RateLog wal(path, std::numeric_limits<std::size_t>::max());
+            StaticRateProvider provider("USD");
+            provider.attachLog(wal);
+            double elapsed = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+            return std::make_pair(elapsed, provider.snapshot()->getCustomRates().size());
+        };
+        auto fullReplay = recover();
+
+        {
+            RateLog wal(path);
+            StaticRateProvider provider("USD");
+            provider.attachLog(wal);
+            wal.checkpoint(*provider.snapshot(), "USD");
+        }
+        auto fromSnapshot = recover();
+        cleanUp();
+
+        out << "rate log: " << options.walUpdates << " updates written in " << std::setprecision(1)
+            << std::chrono::duration<double, std::milli>(written - start).count() << " ms ("
+            << flushes << " syncs); recovery replaying the log " << fullReplay.first
+            << " ms, from snapshot " << fromSnapshot.first << " ms (" << fromSnapshot.second
+            << " overrides)\n";
+    }
+
+    // a 200-rate feed update on a 1000-currency matrix book: 200 publishes
+    // (each copying the book) vs one RateUpdate
+    void runBulkUpdate(std::ostream &out) {
+        StaticRateProvider provider("USD");
+        RateUpdate seed;
+        for (std::size_t i = 0; i < 1000; ++i) {
+            seed.registerCurrency("X" + std::to_string(i), 1.0 + static_cast<double>(i % 97));
+        }
+        provider.applyUpdate(seed);
+        provider.enableCrossRateMatrix();
+
+        const std::size_t feedSize = 200;
+        Clock::time_point start = Clock::now();
+        for (std::size_t i = 0; i < feedSize; ++i) {
+            provider.registerCurrency("X" + std::to_string(i * 5), 2.0 + static_cast<double>(i % 89));
+        }
+        Clock::time_point oneByOne = Clock::now();
+
+        RateUpdate feed;
+        for (std::size_t i = 0; i < feedSize; ++i) {
+            feed.registerCurrency("X" + std::to_string(i * 5), 3.0 + static_cast<double>(i % 89));
+        }
+        provider.applyUpdate(feed);
+        Clock::time_point bulk = Clock::now();
+
+        out << "feed update " << feedSize << " rates, 1000-currency matrix: one by one "
+            << std::setprecision(1)
+            << std::chrono::duration<double, std::milli>(oneByOne - start).count()
+            << " ms, one RateUpdate "
+            << std::chrono::duration<double, std::milli>(bulk - oneByOne).count() << " ms\n";
+    }
+
+    // cost of publishing one override as the matrix grows; each write makes
+    // a new version of the book
+    void runOverrideWrites(std::ostream &out) {
+        for (std::size_t universe : {std::size_t{100}, std::size_t{1000}, std::size_t{2000}}) {
+            if (universe > options.maxMatrixUniverse) break;
+            StaticRateProvider provider("USD");
+            RateUpdate seed;
+            for (std::size_t i = 0; i < universe; ++i) {
+                seed.registerCurrency("X" + std::to_string(i), 1.0 + static_cast<double>(i % 97));
+            }
+            provider.applyUpdate(seed);
+            provider.enableCrossRateMatrix();
+
+            const std::size_t writes = 200;
+            Clock::time_point start = Clock::now();
+            for (std::size_t i = 0; i < writes; ++i) {
+                provider.setCustomRate("X" + std::to_string(i * 7 % universe),
+                                       "X" + std::to_string((i * 13 + 1) % universe),
+                                       1.0 + static_cast<double>(i % 11));
+            }
+            double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            out << "override write N=" << universe << " matrix: " << std::setprecision(1)
+                << us / writes << " us per write\n";
+        }
+    }
+
+    // skewed traffic: 90% of lookups on 4 hot pairs, the rest spread over
+    // 1000 currencies, with and without the per-thread quote cache
+    void runQuoteCache(std::ostream &out) {
+        StaticRateProvider provider("USD");
+        RateUpdate seed;
+        for (std::size_t i = 0; i < 1000 - provider.getSupportedCodes().size(); ++i) {
+            seed.registerCurrency("X" + std::to_string(i), 1.0 + static_cast<double>(i % 97));
+        }
+        provider.applyUpdate(seed);
+        TriangulatingRateProvider graph(provider);
+        graph.setCustomRate("EUR", "GBP", 0.86);
+        QuoteCache<StaticRateProvider> cachedBook(provider);
+        QuoteCache<TriangulatingRateProvider> cachedGraph(graph);
+
+        const std::size_t queries = 4096;
+        std::vector<std::pair<CurrencyId, CurrencyId>> traffic(queries);
+        const std::pair<const char *, const char *> hot[] = {
+            {"USD", "EUR"}, {"USD", "INR"}, {"EUR", "USD"}, {"USD", "GBP"}};
+        std::mt19937 rng(11);
+        for (auto &q : traffic) {
+            if (rng() % 10 != 0) {
+                const auto &pair = hot[rng() % 4];
+                q = {provider.findCurrency(pair.first), provider.findCurrency(pair.second)};
+            } else {
+                q = {static_cast<CurrencyId>(rng() % 1000), static_cast<CurrencyId>(rng() % 1000)};
+            }
+        }
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "getRate skewed, StaticRateProvider", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         const auto &q = traffic[i % queries];
+                         return provider.tryGetRate(q.first, q.second).value();
+                     }));
+            printRow(out, "getRate skewed, quote cache", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         const auto &q = traffic[i % queries];
+                         return cachedBook.tryGetRate(q.first, q.second).value();
+                     }));
+            printRow(out, "getRate skewed, triangulating", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         const auto &q = traffic[i % queries];
+                         return graph.tryGetRate(q.first, q.second).value();
+                     }));
+            printRow(out, "getRate skewed, triangulating + cache", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         const auto &q = traffic[i % queries];
+                         return cachedGraph.tryGetRate(q.first, q.second).value();
+                     }));
+        }
+        out << "quote cache hit rate: " << std::setprecision(1)
+            << cachedBook.getStats().hitRate() * 100.0 << "% (book), "
+            << cachedGraph.getStats().hitRate() * 100.0 << "% (triangulating)\n";
+    }
+
+    // Lookups straight from a shared-memory segment, as a reader process
+    // makes them, first with the writer idle, then with it publishing a new
+    // override back to back.
+    void runSharedBook(std::ostream &out) {
+#ifdef CURRENCY_CONVERTER_POSIX
+        const std::size_t universe = 1000;
+        const std::string name = "/currency_bench_" + std::to_string(::getpid());
+        StaticRateProvider writer("USD");
+        std::vector<std::string> codes = writer.getSupportedCodes();
+        std::unordered_set<std::string> taken(codes.begin(), codes.end());
+        RateUpdate currencies;
+        for (std::size_t i = 0; codes.size() < universe; ++i) {
+            std::string code = makeCode(i);
+            if (taken.insert(code).second) {
+                currencies.registerCurrency(code, 0.5 + static_cast<double>(i % 1000));
+                codes.push_back(code);
+            }
+        }
+        writer.applyUpdate(currencies);
+        writer.enableCrossRateMatrix();
+
+        SharedRateBook segment(name, 1024, 4096);
+        writer.shareTo(segment);
+        SharedRateProvider reader(name);
+
+        const std::size_t mask = 4095;
+        std::mt19937_64 rng(21);
+        std::vector<CurrencyPair> queries(mask + 1);
+        for (CurrencyPair &q : queries) {
+            q = {reader.findCurrency(codes[rng() % codes.size()]),
+                 reader.findCurrency(codes[rng() % codes.size()])};
+        }
+
+        const int publishes = 50;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < publishes; ++i) {
+            writer.setCustomRate(codes[i], codes[i + 1], 1.0 + i);
+        }
+        double publishUs = elapsedNs(start, Clock::now()) / publishes / 1000.0;
+        out << "shared segment N=" << universe << ": " << segment.segmentBytes() / 1024
+            << " KiB mapped once per host; publish one override " << std::setprecision(1)
+            << publishUs << " us\n";
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "getRate shared segment N=1000", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         const CurrencyPair &q = queries[(i + t * 7919) & mask];
+                         return reader.getRate(q.from, q.to);
+                     }));
+        }
+
+        std::atomic<bool> done{false};
+        std::thread publisher([&] {
+            for (std::size_t i = 0; !done.load(std::memory_order_relaxed); ++i) {
+                writer.setCustomRate(codes[i % 500], codes[500 + i % 500], 1.0 + static_cast<double>(i % 7));
+            }
+        });
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "getRate shared segment, writer busy", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         const CurrencyPair &q = queries[(i + t * 7919) & mask];
+                         return reader.getRate(q.from, q.to);
+                     }));
+        }
+        done = true;
+        publisher.join();
+        SharedRateBook::remove(name);
+#else
+        out << "shared segment: skipped (needs POSIX shared memory)\n";
+#endif
+    }
+
+    // as-of lookups in compressed minute ticks; rates move in 4th-decimal steps
+    void runHistory(std::ostream &out) {
+        const std::vector<std::string> codes = {"EUR", "INR", "GBP", "JPY", "AUD", "CAD"};
+        const std::int64_t start = 1700000000;  // seconds
+        HistoricalRateProvider history("USD");
+        std::mt19937_64 rng(7);
+        for (std::size_t c = 0; c < codes.size(); ++c) {
+            double rate = 1.0 + static_cast<double>(c) * 17.0;
+            for (std::size_t i = 0; i < options.historyTicks; ++i) {
+                rate = std::max(0.0001, rate + (static_cast<double>(rng() % 21) - 10.0) * 0.0001);
+                history.record(codes[c], start + static_cast<std::int64_t>(i) * 60,
+                               std::round(rate * 10000.0) / 10000.0);
+            }
+        }
+        history.shrinkToFit();
+
+        double bytesPerPoint = static_cast<double>(history.memoryBytes()) /
+                               static_cast<double>(history.pointCount());
+        out << "\nhistory: " << history.pointCount() << " points, " << std::setprecision(2)
+            << bytesPerPoint << " bytes/point (16 uncompressed)\n";
+
+        CurrencyId eur = history.findCurrency("EUR");
+        CurrencyId inr = history.findCurrency("INR");
+        std::int64_t span = static_cast<std::int64_t>(options.historyTicks) * 60;
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "as-of getRate EUR->INR (random time)", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         std::int64_t at = start + static_cast<std::int64_t>(i * 2654435761u % span);
+                         return history.tryGetRate(eur, inr, at).value();
+                     }));
+        }
+
+        // one pass over transactions sorted by (pair, time): merge join vs
+        // an independent as-of lookup per row
+        TransactionColumns rows;
+        std::vector<std::pair<std::uint64_t, std::int64_t>> keys(options.repriceRows);
+        for (auto &key : keys) {
+            CurrencyId from = static_cast<CurrencyId>(rng() % (codes.size() + 1));
+            CurrencyId to   = static_cast<CurrencyId>(rng() % (codes.size() + 1));
+            key = {pairKey(from, to), start + static_cast<std::int64_t>(rng() % span)};
+        }
+        std::sort(keys.begin(), keys.end());
+        for (const auto &key : keys) {
+            rows.from.push_back(static_cast<CurrencyId>(key.first >> 32));
+            rows.to.push_back(static_cast<CurrencyId>(key.first));
+            rows.timestamps.push_back(key.second);
+            rows.amounts.push_back(static_cast<double>(rows.amounts.size() % 5000) + 0.25);
+        }
+
+        Clock::time_point joinStart = Clock::now();
+        RepricedColumns repriced = RepricingJoin(history).run(rows);
+        Clock::time_point joinEnd = Clock::now();
+
+        std::vector<double> lookedUp(rows.size());
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            lookedUp[i] = rows.amounts[i] *
+                          history.tryGetRate(rows.from[i], rows.to[i], rows.timestamps[i]).value();
+        }
+        Clock::time_point lookupEnd = Clock::now();
+
+        double rowCount = static_cast<double>(rows.size());
+        out << "reprice " << rows.size() << " rows: merge join " << std::setprecision(1)
+            << std::chrono::duration<double, std::nano>(joinEnd - joinStart).count() / rowCount
+            << " ns/row, as-of lookup per row "
+            << std::chrono::duration<double, std::nano>(lookupEnd - joinEnd).count() / rowCount
+            << " ns/row (checksum " << std::setprecision(0)
+            << std::accumulate(repriced.amounts.begin(), repriced.amounts.end(), 0.0) +
+                   std::accumulate(lookedUp.begin(), lookedUp.end(), 0.0)
+            << ")\n";
+    }
+
+    // memoised multi-hop custom paths vs pairs that fall back to base rates
+    void runTriangulation(std::ostream &out) {
+        StaticRateProvider provider("USD");
+        provider.enableCrossRateMatrix();
+        TriangulatingRateProvider graph(provider);
+        graph.setCustomRate("EUR", "GBP", 0.86);
+        graph.setCustomRate("GBP", "JPY", 180.0);
+        graph.setCustomRate("JPY", "INR", 0.55);
+
+        CurrencyId eur = provider.findCurrency("EUR");
+        CurrencyId inr = provider.findCurrency("INR");
+        CurrencyId usd = provider.findCurrency("USD");
+        CurrencyId cad = provider.findCurrency("CAD");
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "getRate 3-hop custom path (memo hit)", threads,
+                     measure(threads, [&](unsigned, std::size_t) {
+                         return graph.tryGetRate(eur, inr).value();
+                     }));
+            printRow(out, "getRate no custom path (fallback)", threads,
+                     measure(threads, [&](unsigned, std::size_t) {
+                         return graph.tryGetRate(usd, cad).value();
+                     }));
+        }
+
+        // incremental cycle check after one edge changes, in a consistent
+        // book of 1000 currencies and 4000 overrides
+        const std::size_t nodes = 1000;
+        RateGraph book;
+        std::vector<double> value(nodes);
+        for (std::size_t i = 0; i < nodes; ++i) value[i] = 1.0 + static_cast<double>(i % 97) / 10.0;
+        std::vector<std::pair<CurrencyId, CurrencyId>> edges;
+        for (std::size_t i = 0; i < nodes * 4; ++i) {
+            CurrencyId from = static_cast<CurrencyId>(i % nodes);
+            CurrencyId to   = static_cast<CurrencyId>((i * 7919 + 1) % nodes);
+            if (from == to) continue;
+            book.setEdge(from, to, value[from] / value[to]);
+            edges.emplace_back(from, to);
+        }
+        ArbitrageDetector detector;
+        std::size_t checkOps     = std::max<std::size_t>(options.opsPerThread / 10000, 50);
+        std::size_t checkSamples = std::max<std::size_t>(options.latencySamples / 10000, 50);
+        printRow(out, "arbitrage check 1000 ccy / 4000 edges", 1,
+                 measure(1, checkOps, checkSamples,
+                         [&](unsigned, std::size_t i) {
+                             const auto &edge = edges[i % edges.size()];
+                             return detector.checkEdge(book, edge.first, edge.second) ? 1.0 : 0.0;
+                         }));
+    }
+
+    // Resolving every ISO 4217 code three ways: a std::map keyed by code
+    // (how the app kept its currencies), the registry behind every provider,
+    // and the compile-time perfect hash.
+    void runIsoTable(std::ostream &out) {
+        std::vector<std::string> codes;
+        std::map<std::string, CurrencyId> byCode;
+        CurrencyRegistry registry;
+        for (const IsoCurrency *entry = Iso4217::begin(); entry != Iso4217::end(); ++entry) {
+            codes.emplace_back(entry->code);
+            byCode.emplace(entry->code, registry.intern(entry->code));
+        }
+        std::size_t count = codes.size();
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "resolve ISO code std::map", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return static_cast<double>(byCode.find(codes[(i * 7919 + t) % count])->second);
+                     }));
+            printRow(out, "resolve ISO code CurrencyRegistry", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return static_cast<double>(registry.find(codes[(i * 7919 + t) % count]));
+                     }));
+            printRow(out, "resolve ISO code Iso4217 perfect hash", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return static_cast<double>(Iso4217::find(codes[(i * 7919 + t) % count])->numeric);
+                     }));
+        }
+    }
+
+    // Amount text both ways: iostreams (what the interactive menu used),
+    // the standard from_chars/to_chars, and AmountText. Inputs are typical
+    // two-decimal amounts; each thread has its own streams.
+    void runAmountText(std::ostream &out) {
+        const std::size_t rows = 1024;
+        std::vector<std::string> texts(rows);
+        std::vector<double> values(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            values[i] = static_cast<double>(i * 7919 % 10000000) / 100.0;
+            texts[i]  = AmountText::toFixed(values[i], 2);
+        }
+
+        for (unsigned threads : threadCounts()) {
+            std::vector<std::istringstream> inputs(threads);
+            std::vector<std::ostringstream> outputs(threads);
+            for (std::ostringstream &stream : outputs) stream << std::fixed << std::setprecision(2);
+            std::vector<std::vector<char>> buffers(threads, std::vector<char>(AmountText::kMaxFixedLength));
+
+            printRow(out, "parse amount istringstream", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         std::istringstream &in = inputs[t];
+                         in.clear();
+                         in.str(texts[i % rows]);
+                         double value = 0.0;
+                         in >> value;
+                         return value;
+                     }));
+            printRow(out, "parse amount from_chars", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         const std::string &text = texts[i % rows];
+                         double value = 0.0;
+                         std::from_chars(text.data(), text.data() + text.size(), value);
+                         return value;
+                     }));
+            printRow(out, "parse amount AmountText", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         double value = 0.0;
+                         AmountText::parse(texts[i % rows], value);
+                         return value;
+                     }));
+            printRow(out, "format amount ostringstream fixed 2", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         std::ostringstream &stream = outputs[t];
+                         stream.str(std::string());
+                         stream << values[i % rows];
+                         return static_cast<double>(stream.tellp());
+                     }));
+            printRow(out, "format amount to_chars fixed 2", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         char *text = buffers[t].data();
+                         return static_cast<double>(
+                             std::to_chars(text, text + AmountText::kMaxFixedLength, values[i % rows],
+                                           std::chars_format::fixed, 2).ptr - text);
+                     }));
+            printRow(out, "format amount AmountText fixed 2", threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         char *text = buffers[t].data();
+                         return static_cast<double>(AmountText::formatFixed(text, values[i % rows], 2) - text);
+                     }));
+        }
+    }
+
+    // exact Money conversions against the double path, single and batched
+    void runMoneyPath(std::ostream &out) {
+        StaticRateProvider provider("USD");
+        BasicCurrencyConverter<StaticRateProvider> converter(provider);
+        CurrencyId usd = provider.findCurrency("USD");
+        CurrencyId jpy = provider.findCurrency("JPY");
+
+        const std::size_t rows = 1024;
+        std::vector<double> amounts(rows);
+        std::vector<std::int64_t> minorAmounts(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            minorAmounts[i] = static_cast<std::int64_t>(i * 3797 % 1000000);
+            amounts[i] = static_cast<double>(minorAmounts[i]) / 100.0;
+        }
+
+        std::size_t batchOps     = std::max<std::size_t>(options.opsPerThread / rows, 100);
+        std::size_t batchSamples = std::max<std::size_t>(options.latencySamples / rows, 100);
+
+        RateSnapshot pinned = provider.pin();
+        BasicCurrencyConverter<RateSnapshot> pinnedConverter(pinned);
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "convert double USD->JPY", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         return converter.tryConvert(usd, jpy, amounts[i % rows]).value();
+                     }));
+            printRow(out, "convert double USD->JPY, pinned snapshot", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         return pinnedConverter.tryConvert(usd, jpy, amounts[i % rows]).value();
+                     }));
+            printRow(out, "convert Money USD->JPY", threads,
+                     measure(threads, [&](unsigned, std::size_t i) {
+                         Money amount(minorAmounts[i % rows], usd);
+                         return static_cast<double>(
+                             converter.tryConvert(amount, jpy).value().getMinorAmount());
+                     }));
+
+            std::vector<std::vector<double>> doubleOut(threads, std::vector<double>(rows));
+            std::vector<std::vector<std::int64_t>> exactOut(threads, std::vector<std::int64_t>(rows));
+            printRow(out, "convertBatch double x1024 (per batch)", threads,
+                     measure(threads, batchOps, batchSamples, [&](unsigned t, std::size_t i) {
+                         converter.convertBatch(usd, jpy, amounts.data(), doubleOut[t].data(), rows);
+                         return doubleOut[t][i % rows];
+                     }));
+            printRow(out, "convertBatch Money x1024 (per batch)", threads,
+                     measure(threads, batchOps, batchSamples, [&](unsigned t, std::size_t i) {
+                         converter.convertBatch(usd, jpy, minorAmounts.data(), exactOut[t].data(), rows);
+                         return static_cast<double>(exactOut[t][i % rows]);
+                     }));
+        }
+    }
+
+    // bad client input: an unknown code rejected by exception vs by Result
+    void runErrorPath(std::ostream &out) {
+        StaticRateProvider provider("USD");
+        CurrencyConverter converter(provider);
+        CurrencyId usd = provider.findCurrency("USD");
+
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "convert unsupported (throws)", threads,
+                     measure(threads, [&](unsigned, std::size_t) {
+                         try {
+                             return converter.convert(usd, kInvalidCurrencyId, 100.0);
+                         } catch (const std::exception &) {
+                             return 0.0;
+                         }
+                     }));
+            printRow(out, "tryConvert unsupported", threads,
+                     measure(threads, [&](unsigned, std::size_t) {
+                         return converter.tryConvert(usd, kInvalidCurrencyId, 100.0).value();
+                     }));
+        }
+    }
+
+    void runRateLookups(std::ostream &out, std::size_t universe) {
+        StaticRateProvider provider("USD");
+        std::vector<std::string> codes = provider.getSupportedCodes();
+        std::unordered_set<std::string> taken(codes.begin(), codes.end());
+        RateUpdate currencies;
+        for (std::size_t i = 0; codes.size() < universe; ++i) {
+            std::string code = makeCode(i);
+            if (taken.insert(code).second) {
+                currencies.registerCurrency(code, 0.5 + static_cast<double>(i % 1000));
+                codes.push_back(code);
+            }
+        }
+        provider.applyUpdate(currencies);
+
+        // overrides sit on a fixed set of pairs; misses draw from all other pairs
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<std::size_t> pickCode(0, codes.size() - 1);
+        std::vector<CurrencyPair> overridden, plain;
+        std::unordered_map<std::uint64_t, bool> seen;
+        RateUpdate overrides;
+        std::size_t pairCount     = codes.size() * (codes.size() - 1);
+        std::size_t overrideCount = std::min<std::size_t>(codes.size() * 2, 512);
+        std::size_t plainCount    = std::min<std::size_t>(pairCount - overrideCount, 4096);
+        while (overridden.size() < overrideCount || plain.size() < plainCount) {
+            const std::string &from = codes[pickCode(rng)];
+            const std::string &to   = codes[pickCode(rng)];
+            CurrencyPair pair{provider.findCurrency(from), provider.findCurrency(to)};
+            if (pair.from == pair.to || !seen.emplace(pairKey(pair.from, pair.to), true).second) {
+                continue;
+            }
+            if (overridden.size() < overrideCount) {
+                overrides.setCustomRate(from, to, 1.0 + static_cast<double>(overridden.size()));
+                overridden.push_back(pair);
+            } else {
+                plain.push_back(pair);
+            }
+        }
+        provider.applyUpdate(overrides);
+
+        CurrencyConverter converter(provider);
+        BasicCurrencyConverter<StaticRateProvider> staticConverter(provider);
+        for (unsigned threads : threadCounts()) {
+            printRow(out, "resolve code N=" + std::to_string(universe), threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return static_cast<double>(provider.findCurrency(codes[(i * 7919 + t) % codes.size()]));
+                     }));
+            // string overloads: two resolves and one lookup per call
+            printRow(out, "convert code N=" + std::to_string(universe), threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return converter.convert(codes[(i * 7919 + t) % codes.size()],
+                                                  codes[(i * 104729 + t + 1) % codes.size()], 100.0);
+                     }));
+            printRow(out, "convert static code N=" + std::to_string(universe), threads,
+                     measure(threads, [&](unsigned t, std::size_t i) {
+                         return staticConverter.convert(codes[(i * 7919 + t) % codes.size()],
+                                                        codes[(i * 104729 + t + 1) % codes.size()], 100.0);
+                     }));
+        }
+        for (const char *mode : {"computed", "matrix"}) {
+            if (std::string(mode) == "matrix") {
+                if (universe > options.maxMatrixUniverse) break;
+                provider.enableCrossRateMatrix();
+            }
+
+            for (double hitRatio : options.hitRatios) {
+                const std::size_t mask = 4095;
+                std::vector<CurrencyPair> queries(mask + 1);
+                std::bernoulli_distribution hit(hitRatio);
+                for (CurrencyPair &q : queries) {
+                    q = hit(rng) ? overridden[rng() % overridden.size()] : plain[rng() % plain.size()];
+                }
+
+                std::ostringstream suffix;
+                suffix << " " << mode << " N=" << universe
+                       << " hit=" << static_cast<int>(hitRatio * 100) << "%";
+
+                for (unsigned threads : threadCounts()) {
+                    printRow(out, "getRate" + suffix.str(), threads,
+                             measure(threads, [&](unsigned t, std::size_t i) {
+                                 const CurrencyPair &q = queries[(i + t * 7919) & mask];
+                                 return provider.getRate(q.from, q.to);
+                             }));
+                    printRow(out, "convert" + suffix.str(), threads,
+                             measure(threads, [&](unsigned t, std::size_t i) {
+                                 const CurrencyPair &q = queries[(i + t * 7919) & mask];
+                                 return converter.convert(q.from, q.to, 100.0);
+                             }));
+                    printRow(out, "convert static" + suffix.str(), threads,
+                             measure(threads, [&](unsigned t, std::size_t i) {
+                                 const CurrencyPair &q = queries[(i + t * 7919) & mask];
+                                 return staticConverter.convert(q.from, q.to, 100.0);
+                             }));
+                }
+            }
+        }
+    }
+};
+
+// ------------------------ Self-test Layer ------------------------
+
+// Round-trip and recovery checks of the on-disk and in-memory encodings, run
+// by --selftest. Each check prints one line and returns an empty string on
+// success or what went wrong; run() returns how many failed.
+class SelfTest {
+    std::string scratchDir;
+
+    std::string scratchPath(const std::string &suffix) const {
+        return scratchDir + "/currency_selftest_" + std::to_string(std::random_device{}()) + "." + suffix;
+    }
+
+    static std::vector<unsigned char> readFile(const std::string &path) {
+        MappedFile file(path);
+        return std::vector<unsigned char>(file.data(), file.data() + file.size());
+    }
+
+    static void writeFile(const std::string &path, const unsigned char *bytes, std::size_t count) {
+        std::FILE *out = std::fopen(path.c_str(), "wb");
+        if (!out) throw std::runtime_error("Cannot create " + path);
+        bool written = std::fwrite(bytes, 1, count, out) == count;
+        written = std::fclose(out) == 0 && written;
+        if (!written) throw std::runtime_error("Cannot write " + path);
+    }
+
+    static void removeLog(const std::string &path) {
+        std::remove(path.c_str());
+        std::remove((path + ".snap").c_str());
+        std::remove((path + ".tmp").c_str());
+    }
+
+    // the state a sequence of updates leaves, last change per key winning
+    struct LogState {
+        std::map<std::string, std::pair<double, int>> currencies;
+        std::map<std::pair<std::string, std::string>, double> overrides;
+
+        void apply(const RateUpdate &update) {
+            for (const RateUpdate::CurrencyChange &change : update.currencies()) {
+                currencies[change.code] = {change.rateVsBase, change.minorUnits};
+            }
+            for (const RateUpdate::OverrideChange &change : update.overrides()) {
+                overrides[{change.from, change.to}] = change.rate;
+            }
+        }
+
+        bool operator==(const LogState &other) const {
+            return currencies == other.currencies && overrides == other.overrides;
+        }
+    };
+
+    static LogState stateOf(const std::vector<RateUpdate> &updates, std::size_t count) {
+        LogState state;
+        for (std::size_t i = 0; i < count; ++i) state.apply(updates[i]);
+        return state;
+    }
+
+    static LogState recoverState(const std::string &path) {
+        RateLog log(path);
+        LogState state;
+        state.apply(log.recover());
+        return state;
+    }
+
+    // A log of a few frames, then its last frame cut at every byte and, in
+    // turn, each of its bytes corrupted. Recovery must return exactly the
+    // frames before it, and a frame appended after recovering a cut log must
+    // survive the next recovery.
+    std::string checkRateLogTail() {
+        const std::string path = scratchPath("wal");
+        std::vector<RateUpdate> frames(4);
+        frames[0].registerCurrency("EUR", 0.92).registerCurrency("JPY", 141.5, 0);
+        frames[1].setCustomRate("USD", "INR", 90.0);
+        frames[2].registerCurrency("EUR", 0.93).setCustomRate("EUR", "GBP", 0.85);
+        frames[3].registerCurrency("KWD", 0.31, 3).setCustomRate("USD", "INR", 91.0);
+        RateUpdate extra;
+        extra.setCustomRate("GBP", "JPY", 190.0);
+
+        std::size_t lastStart = 0, end = 0;
+        {
+            removeLog(path);
+            RateLog log(path);
+            log.recover();
+            for (std::size_t i = 0; i + 1 < frames.size(); ++i) log.waitDurable(log.append(frames[i]));
+            lastStart = readFile(path).size();
+            log.waitDurable(log.append(frames.back()));
+        }
+        std::vector<unsigned char> bytes = readFile(path);
+        end = bytes.size();
+
+        LogState before = stateOf(frames, frames.size() - 1);
+        LogState all    = stateOf(frames, frames.size());
+        std::string problem;
+        for (std::size_t cut = lastStart; cut <= end && problem.empty(); ++cut) {
+            removeLog(path);
+            writeFile(path, bytes.data(), cut);
+            LogState expected = cut == end ? all : before;
+            {
+                RateLog log(path);
+                LogState state;
+                state.apply(log.recover());
+                if (!(state == expected)) {
+                    problem = "log cut at byte " + std::to_string(cut) + " recovered the wrong state";
+                    break;
+                }
+                log.waitDurable(log.append(extra));
+            }
+            expected.apply(extra);
+            if (!(recoverState(path) == expected)) {
+                problem = "frame appended after a cut at byte " + std::to_string(cut) + " was lost";
+            }
+        }
+        for (std::size_t at = lastStart; at < end && problem.empty(); ++at) {
+            std::vector<unsigned char> corrupt = bytes;
+            corrupt[at] ^= 0x10;
+            removeLog(path);
+            writeFile(path, corrupt.data(), corrupt.size());
+            if (!(recoverState(path) == before)) {
+                problem = "corrupt byte " + std::to_string(at) + " of the last frame was replayed";
+            }
+        }
+        removeLog(path);
+        return problem;
+    }
+
+    // An update the log refuses (a code too long to encode) must leave both
+    // the provider and the log as they were, including its valid changes.
+    std::string checkRejectedCommit() {
+        const std::string path = scratchPath("wal");
+        removeLog(path);
+        std::string problem;
+        {
+            RateLog log(path);
+            StaticRateProvider provider("USD");
+            provider.attachLog(log);
+            RateUpdate accepted, rejected;
+            accepted.registerCurrency("EUR", 0.93);
+            rejected.registerCurrency("EUR", 0.5).registerCurrency(std::string(300, 'X'), 2.0);
+            provider.applyUpdate(accepted);
+            std::uint64_t version = provider.getVersion();
+            try {
+                provider.applyUpdate(rejected);
+                problem = "an update with a 300-character code was accepted";
+            } catch (const std::invalid_argument &) {
+            }
+            if (problem.empty() && (provider.getVersion() != version ||
+                                    provider.getRate("USD", "EUR") != 0.93)) {
+                problem = "a rejected update was published";
+            }
+            if (problem.empty() && !(recoverState(path) == stateOf({accepted}, 1))) {
+                problem = "a rejected update reached the log";
+            }
+        }
+        removeLog(path);
+        return problem;
+    }
+
+    // A flush that fails part way (here: the file size limit cuts the write)
+    // must not be followed by acknowledged frames recovery would never
+    // reach. The log refuses everything after it, and a restart recovers
+    // exactly the frames acknowledged before.
+    std::string checkFailedFlush() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        const std::string path = scratchPath("wal");
+        removeLog(path);
+        RateUpdate first, cut, later;
+        first.registerCurrency("EUR", 0.92);
+        cut.registerCurrency("GBP", 0.79).setCustomRate("USD", "INR", 90.0);
+        later.registerCurrency("JPY", 141.5, 0);
+
+        std::string problem;
+        {
+            RateLog log(path);
+            log.recover();
+            log.waitDurable(log.append(first));
+
+            struct rlimit saved;
+            ::getrlimit(RLIMIT_FSIZE, &saved);
+            struct rlimit limit = saved;
+            limit.rlim_cur = static_cast<rlim_t>(readFile(path).size() + 10);
+            auto previous = std::signal(SIGXFSZ, SIG_IGN);
+            ::setrlimit(RLIMIT_FSIZE, &limit);
+            bool failed = false;
+            try {
+                log.waitDurable(log.append(cut));
+            } catch (const std::runtime_error &) {
+                failed = true;
+            }
+            ::setrlimit(RLIMIT_FSIZE, &saved);
+            std::signal(SIGXFSZ, previous);
+
+            if (!failed) {
+                problem = "a write past the file size limit succeeded";
+            } else {
+                try {
+                    log.waitDurable(log.append(later));
+                    problem = "the log acknowledged a frame after a failed flush";
+                } catch (const std::runtime_error &) {
+                }
+            }
+        }
+        if (problem.empty() && !(recoverState(path) == stateOf({first}, 1))) {
+            problem = "recovery after a failed flush returned the wrong state";
+        }
+        removeLog(path);
+        return problem;
+#else
+        return std::string();
+#endif
+    }
+
+    static bool sameBits(double a, double b) { return std::memcmp(&a, &b, sizeof a) == 0; }
+
+    // Random series through the Gorilla codec, with NaN payloads, signed
+    // zeros, infinities, subnormals, runs of equal timestamps and gaps up to
+    // 2^60. Every point must read back bit for bit through valueAt and a
+    // cursor, the later of equal timestamps winning.
+    std::string checkRateSeries() {
+        std::mt19937_64 rng(14);
+        const double specials[] = {std::numeric_limits<double>::quiet_NaN(), -0.0, 0.0,
+                                   std::numeric_limits<double>::infinity(),
+                                   -std::numeric_limits<double>::infinity(),
+                                   std::numeric_limits<double>::denorm_min(), 83.10};
+        for (int round = 0; round < 200; ++round) {
+            std::size_t count = rng() % (RateSeries::kBlockPoints * 5);
+            std::vector<std::int64_t> times(count);
+            std::vector<double> values(count);
+            std::int64_t time = static_cast<std::int64_t>(rng() % 2000000) - 1000000;
+            int gaps = 0;
+            double value = 1.0;
+            for (std::size_t i = 0; i < count; ++i) {
+                switch (rng() % 6) {
+                    case 0: break;                                                      // equal timestamp
+                    case 1: time += 60; break;
+                    case 2: time += static_cast<std::int64_t>(rng() % 100000); break;
+                    case 3: if (gaps++ < 3) time += static_cast<std::int64_t>(rng() >> 4); break;  // < 2^60
+                    default: time += 1; break;
+                }
+                switch (rng() % 5) {
+                    case 0: break;                                                      // unchanged
+                    case 1: value = specials[rng() % (sizeof specials / sizeof specials[0])]; break;
+                    case 2: {
+                        std::uint64_t raw = rng();
+                        std::memcpy(&value, &raw, sizeof value);  // any bit pattern, NaN payloads included
+                        break;
+                    }
+                    default: value = std::nextafter(value + 1e-4, 1e300); break;
+                }
+                times[i]  = time;
+                values[i] = value;
+            }
+
+            RateSeries series;
+            for (std::size_t i = 0; i < count; ++i) series.append(times[i], values[i]);
+            if (series.size() != count) return "size mismatch in round " + std::to_string(round);
+            if (count > 0 && !sameBits(series.valueAt(times[0] - 1), 0.0)) {
+                return "value before the first point in round " + std::to_string(round);
+            }
+
+            RateSeries::Cursor cursor = series.cursor(count > 0 ? times[0] : 0);
+            for (std::size_t i = 0; i < count; ++i) {
+                if (i + 1 < count && times[i + 1] == times[i]) continue;  // the later point wins
+                if (!sameBits(series.valueAt(times[i]), values[i]) ||
+                    !sameBits(cursor.advanceTo(times[i]), values[i])) {
+                    return "point " + std::to_string(i) + " of round " + std::to_string(round) +
+                           " read back wrong";
+                }
+                if (i + 1 < count && times[i + 1] - times[i] > 1 &&
+                    !sameBits(series.valueAt(times[i + 1] - 1), values[i])) {
+                    return "gap after point " + std::to_string(i) + " of round " + std::to_string(round);
+                }
+            }
+        }
+        return std::string();
+    }
+
+    // Readers of a shared segment racing a writer that keeps publishing. Each
+    // update sets AAA to g and BBB to 2g in one publish, so AAA -> BBB must
+    // read exactly 2 every time; a reader that mixed two versions would see
+    // another ratio. Run with and without the segment's cross-rate table
+    // (without it, a lookup reads several words under the seqlock).
+    std::string checkSharedBookReaders() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        for (std::size_t capacity : {std::size_t{64}, SharedRateBook::kMaxMatrixCapacity + 1}) {
+            const std::string name = "/currency_selftest_" + std::to_string(::getpid());
+            StaticRateProvider writer("USD");
+            writer.applyUpdate(RateUpdate().registerCurrency("AAA", 1.0).registerCurrency("BBB", 2.0));
+            SharedRateBook segment(name, capacity, 16);
+            writer.shareTo(segment);
+            SharedRateProvider reader(name);
+            CurrencyId a = reader.findCurrency("AAA");
+            CurrencyId b = reader.findCurrency("BBB");
+
+            std::atomic<bool> done{false};
+            std::atomic<std::size_t> torn{0}, reads{0};
+            std::vector<std::thread> readers;
+            for (unsigned t = 0; t < std::max(2u, std::thread::hardware_concurrency()); ++t) {
+                readers.emplace_back([&] {
+                    std::size_t count = 0;
+                    while (!done.load(std::memory_order_relaxed)) {
+                        Result<double> rate = reader.tryGetRate(a, b);
+                        if (!rate || rate.value() != 2.0 || reader.findCurrency("BBB") != b) {
+                            torn.fetch_add(1);
+                        }
+                        ++count;
+                    }
+                    reads.fetch_add(count);
+                });
+            }
+            auto stop = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+            for (std::size_t i = 1; std::chrono::steady_clock::now() < stop; ++i) {
+                double g = 1.0 + static_cast<double>(i % 1000) * 0.37;
+                writer.applyUpdate(RateUpdate().registerCurrency("AAA", g).registerCurrency("BBB", 2.0 * g));
+            }
+            done = true;
+            for (std::thread &thread : readers) thread.join();
+            SharedRateBook::remove(name);
+            if (torn.load() != 0) {
+                return std::to_string(torn.load()) + " of " + std::to_string(reads.load()) +
+                       " reads saw a half-applied publish (capacity " + std::to_string(capacity) + ")";
+            }
+        }
+#endif
+        return std::string();
+    }
+
+    // Rates that are negative or not finite, and minor units outside 0-18,
+    // must be refused before they reach a book.
+    std::string checkRateUpdateRejects() {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const double inf = std::numeric_limits<double>::infinity();
+        StaticRateProvider provider("USD");
+        std::uint64_t before = provider.getVersion();
+        const std::pair<double, int> currencies[] = {{-1.0, 2}, {nan, 2}, {inf, 2}, {1.0, -1}, {1.0, 19}};
+        for (const auto &bad : currencies) {
+            try {
+                provider.registerCurrency("ABC", bad.first, bad.second);
+                return "registerCurrency(" + std::to_string(bad.first) + ", " +
+                       std::to_string(bad.second) + ") was accepted";
+            } catch (const std::runtime_error &) {
+            }
+        }
+        for (double bad : {0.0, -2.0, nan, inf}) {
+            try {
+                provider.setCustomRate("USD", "EUR", bad);
+                return "setCustomRate(" + std::to_string(bad) + ") was accepted";
+            } catch (const std::runtime_error &) {
+            }
+        }
+        if (provider.getVersion() != before) return "a refused update was published";
+        provider.registerCurrency("ABC", 0.0, 18);
+        return provider.getMinorUnits(provider.findCurrency("ABC")) == 18 ? std::string()
+                                                                           : "18 minor units not kept";
+    }
+
+    // A rate book file whose checksum is right but whose rates could never
+    // have come from an update must be refused before anything is loaded.
+    std::string checkRateBookFileRejects() {
+        using File = RateBookFile;
+        StaticRateProvider provider("USD");
+        provider.registerCurrency("EUR", 0.92);
+        provider.setCustomRate("USD", "EUR", 0.9);
+        std::string path = scratchPath("crbk");
+        provider.writeRateBook(path, CurrencyTable());
+        std::vector<unsigned char> good = readFile(path);
+        File::Header header;
+        std::memcpy(&header, good.data(), sizeof(header));
+        const std::size_t overrideTable = sizeof(header) + header.currencyCount * sizeof(File::CurrencyRecord);
+        std::size_t eurRecord = 0, pairRecord = 0;
+        for (std::size_t i = 0; i < header.currencyCount; ++i) {
+            std::size_t at = sizeof(header) + i * sizeof(File::CurrencyRecord);
+            if (std::memcmp(good.data() + at, "EUR", 4) == 0) eurRecord = at;
+        }
+        for (std::size_t i = 0; i < header.overrideCount; ++i) {
+            File::OverrideRecord record;
+            std::memcpy(&record, good.data() + overrideTable + i * sizeof(record), sizeof(record));
+            if (record.rate == 0.9) pairRecord = overrideTable + i * sizeof(record);
+        }
+        if (eurRecord == 0 || pairRecord == 0) {
+            std::remove(path.c_str());
+            return "EUR or its override missing from the written rate book";
+        }
+
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const double inf = std::numeric_limits<double>::infinity();
+        struct Patch {
+            const char *what;
+            std::size_t offset;
+            double rate;
+            int minorUnits;  // -1 = leave alone
+        };
+        const Patch patches[] = {
+            {"negative base rate", eurRecord + offsetof(File::CurrencyRecord, rateVsBase), -0.92, -1},
+            {"NaN base rate", eurRecord + offsetof(File::CurrencyRecord, rateVsBase), nan, -1},
+            {"infinite base rate", eurRecord + offsetof(File::CurrencyRecord, rateVsBase), inf, -1},
+            {"19 minor units", eurRecord + offsetof(File::CurrencyRecord, rateVsBase), 0.92, 19},
+            {"zero override", pairRecord + offsetof(File::OverrideRecord, rate), 0.0, -1},
+            {"negative override", pairRecord + offsetof(File::OverrideRecord, rate), -0.9, -1},
+            {"NaN override", pairRecord + offsetof(File::OverrideRecord, rate), nan, -1},
+        };
+
+        std::string problem;
+        for (const Patch &patch : patches) {
+            std::vector<unsigned char> bytes = good;
+            std::memcpy(bytes.data() + patch.offset, &patch.rate, sizeof(double));
+            if (patch.minorUnits >= 0) {
+                bytes[eurRecord + offsetof(File::CurrencyRecord, minorUnits)] =
+                    static_cast<unsigned char>(patch.minorUnits);
+            }
+            std::uint64_t checksum = File::fnv1a(bytes.data() + sizeof(File::Header),
+                                                 bytes.size() - sizeof(File::Header));
+            std::memcpy(bytes.data() + offsetof(File::Header, checksum), &checksum, sizeof(checksum));
+            writeFile(path, bytes.data(), bytes.size());
+            try {
+                provider.loadRateBook(File(path));
+                problem = std::string(patch.what) + " was loaded";
+                break;
+            } catch (const std::runtime_error &) {
+            }
+        }
+        if (problem.empty() && provider.getRate("USD", "EUR") != 0.9) problem = "a refused file changed the rates";
+        std::remove(path.c_str());
+        return problem;
+    }
+
+    // Overrides of a currency against itself must not change anything: the
+    // cross-rate matrix and direct computation both answer 1.0 for them.
+    std::string checkSelfPairOverrides() {
+        StaticRateProvider computed("USD"), matrix("USD");
+        matrix.enableCrossRateMatrix();
+        for (StaticRateProvider *provider : {&computed, &matrix}) {
+            provider->applyUpdate(RateUpdate().registerCurrency("EUR", 0.9).registerCurrency("GBP", 0.8));
+            provider->setCustomRate("USD", "USD", 2.0);
+            provider->applyUpdate(RateUpdate().setCustomRate("EUR", "EUR", 3.0).setCustomRate("EUR", "GBP", 0.85));
+        }
+        for (const char *from : {"USD", "EUR", "GBP"}) {
+            for (const char *to : {"USD", "EUR", "GBP"}) {
+                Result<double> a = computed.tryGetRate(computed.findCurrency(from), computed.findCurrency(to));
+                Result<double> b = matrix.tryGetRate(matrix.findCurrency(from), matrix.findCurrency(to));
+                if (!a || !b || a.value() != b.value() || (std::strcmp(from, to) == 0 && a.value() != 1.0)) {
+                    return std::string(from) + "->" + to + " differs between matrix and computed rates";
+                }
+            }
+        }
+        return std::string();
+    }
+
+    // Random rate and override changes against two providers, one serving
+    // from the cross-rate matrix, which must agree after every change. Books
+    // kept from earlier versions share matrix rows and override chunks with
+    // later ones, and must still answer exactly as when they were published.
+    std::string checkCopyOnWriteBook() {
+        StaticRateProvider computed("USD"), matrix("USD");
+        matrix.enableCrossRateMatrix();
+        std::mt19937 rng(5);
+        auto code = [&rng] { return "W" + std::to_string(rng() % 40); };
+        auto table = [](const RateBook &book) {
+            std::vector<double> rates;
+            for (CurrencyId from = 0; from < book.currencyCount(); ++from) {
+                for (CurrencyId to = 0; to < book.currencyCount(); ++to) {
+                    Result<double> rate = book.tryGetRate(from, to);
+                    rates.push_back(rate ? rate.value() : 0.0);
+                }
+            }
+            return rates;
+        };
+
+        std::vector<std::pair<std::shared_ptr<const RateBook>, std::vector<double>>> kept;
+        for (int step = 0; step < 400; ++step) {
+            RateUpdate update;
+            for (unsigned n = 1 + rng() % 3; n > 0; --n) {
+                if (rng() % 3 == 0) {
+                    update.registerCurrency(code(), 0.5 + rng() % 100);
+                } else {
+                    update.setCustomRate(code(), code(), 0.25 + rng() % 50);
+                }
+            }
+            computed.applyUpdate(update);
+            matrix.applyUpdate(update);
+            if (step % 25 == 0) {
+                for (StaticRateProvider *provider : {&computed, &matrix}) {
+                    std::shared_ptr<const RateBook> book = provider->snapshot();
+                    kept.emplace_back(book, table(*book));
+                }
+            }
+
+            std::shared_ptr<const RateBook> a = computed.snapshot(), b = matrix.snapshot();
+            if (table(*a) != table(*b)) {
+                return "step " + std::to_string(step) + ": matrix and computed rates differ";
+            }
+        }
+        for (const auto &entry : kept) {
+            if (table(*entry.first) != entry.second) {
+                return "version " + std::to_string(entry.first->getGeneration()) +
+                       " changed after it was published";
+            }
+        }
+        return std::string();
+    }
+
+    // Random override edits against a TriangulatingRateProvider, which keeps
+    // its memo across them, checked after every edit against one freshly
+    // built over the same rates. Rates are powers of two, so every product is
+    // exact: under BestRate the rates must match, under MostDirect (where
+    // equally short paths may differ) the hop counts must, and the rate must
+    // be the product of the current overrides along the reported path.
+    std::string checkTriangulationMemo() {
+        using Policy = TriangulatingRateProvider::PathPolicy;
+        for (Policy policy : {Policy::MostDirect, Policy::BestRate}) {
+            StaticRateProvider inner("USD");
+            RateUpdate currencies;
+            std::vector<std::string> codes;
+            for (int i = 0; i < 10; ++i) {
+                codes.push_back("T" + std::to_string(i));
+                currencies.registerCurrency(codes.back(), 1.0 + i);
+            }
+            inner.applyUpdate(currencies);
+            TriangulatingRateProvider memoised(inner, policy, 3);
+
+            std::mt19937 rng(7);
+            std::map<std::pair<CurrencyId, CurrencyId>, double> edges;
+            for (int step = 0; step < 150; ++step) {
+                std::size_t a = rng() % codes.size(), b = rng() % codes.size();
+                double rate = std::ldexp(1.0, static_cast<int>(rng() % 7) - 3);
+                memoised.setCustomRate(codes[a], codes[b], rate);
+                if (a != b) edges[{inner.findCurrency(codes[a]), inner.findCurrency(codes[b])}] = rate;
+
+                TriangulatingRateProvider fresh(inner, policy, 3);
+                for (int q = 0; q < 30; ++q) {
+                    CurrencyId from = inner.findCurrency(codes[rng() % codes.size()]);
+                    CurrencyId to   = inner.findCurrency(codes[rng() % codes.size()]);
+                    Result<double> got = memoised.tryGetRate(from, to);
+                    Result<double> want = fresh.tryGetRate(from, to);
+                    std::vector<CurrencyId> path = memoised.getPath(from, to);
+                    bool same = got && want;
+                    if (policy == Policy::BestRate) {
+                        same = same && got.value() == want.value();
+                    } else {
+                        double product = 1.0;
+                        for (std::size_t i = 0; i + 1 < path.size(); ++i) {
+                            auto edge = edges.find({path[i], path[i + 1]});
+                            product *= edge == edges.end() ? 0.0 : edge->second;
+                        }
+                        same = same && path.size() == fresh.getPath(from, to).size() &&
+                               (path.empty() ? got.value() == want.value() : got.value() == product);
+                    }
+                    if (!same) {
+                        return "step " + std::to_string(step) + ": " + inner.snapshot()->getCode(from) + "->" +
+                               inner.snapshot()->getCode(to) + " disagrees with a fresh provider";
+                    }
+                }
+            }
+        }
+        return std::string();
+    }
+
+    // An update the shared segment cannot hold (a code longer than 8 bytes)
+    // must be refused before anything changes, and later updates must still
+    // reach both the provider and the segment.
+    std::string checkSharedBookRejects() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        const std::string name = "/currency_selftest_" + std::to_string(::getpid());
+        StaticRateProvider writer("USD");
+        SharedRateBook segment(name, 64, 16);
+        writer.shareTo(segment);
+        SharedRateProvider reader(name);
+        std::uint64_t version = writer.getVersion();
+        std::string problem;
+        try {
+            writer.setCustomRate("ABCDEFGHIJ", "USD", 2.0);
+            problem = "a 10-byte code was accepted";
+        } catch (const std::runtime_error &) {
+        }
+        if (problem.empty() && (writer.getVersion() != version ||
+                                writer.findCurrency("ABCDEFGHIJ") != kInvalidCurrencyId)) {
+            problem = "the refused update was published locally";
+        }
+        if (problem.empty()) {
+            writer.setCustomRate("USD", "EUR", 0.5);
+            if (writer.getRate("USD", "EUR") != 0.5 || reader.getRate("USD", "EUR") != 0.5) {
+                problem = "an update after a refused one did not reach the segment";
+            }
+        }
+        SharedRateBook::remove(name);
+        return problem;
+#else
+        return std::string();
+#endif
+    }
+
+    // A writer that takes over a segment whose last writer died mid-update
+    // (odd sequence) must leave it readable, and the version readers see
+    // must keep increasing across the takeover.
+    std::string checkSharedBookTakeover() {
+#ifdef CURRENCY_CONVERTER_POSIX
+        const std::string name = "/currency_selftest_" + std::to_string(::getpid());
+        std::string problem;
+        {
+            StaticRateProvider first("USD");
+            first.applyUpdate(RateUpdate().registerCurrency("AAA", 1.0).registerCurrency("BBB", 2.0));
+            auto segment = std::make_unique<SharedRateBook>(name, 64, 16);
+            first.shareTo(*segment);
+            SharedRateProvider reader(name);
+            std::uint64_t before = reader.getVersion();
+
+            // the first writer stops between making the sequence odd and even
+            int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+            void *mapped = fd < 0 ? MAP_FAILED
+                                  : ::mmap(nullptr, sizeof(SharedRateBook::Header), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED, fd, 0);
+            if (fd >= 0) ::close(fd);
+            if (mapped == MAP_FAILED) return "cannot map the segment";
+            SharedRateBook::Header *header = static_cast<SharedRateBook::Header *>(mapped);
+            header->sequence.fetch_add(1);
+            segment.reset();
+
+            StaticRateProvider second("USD");
+            second.applyUpdate(RateUpdate().registerCurrency("BBB", 3.0));
+            SharedRateBook takeover(name, 64, 16);
+            second.shareTo(takeover);
+            bool odd = header->sequence.load() & 1;  // readers would wait forever
+            ::munmap(mapped, sizeof(SharedRateBook::Header));
+            if (odd) {
+                problem = "sequence left odd after the new writer published";
+            } else if (reader.getVersion() <= before) {
+                problem = "version went from " + std::to_string(before) + " to " +
+                          std::to_string(reader.getVersion()) + " across a takeover";
+            } else if (reader.getRate("USD", "BBB") != 3.0) {
+                problem = "readers do not see the new writer's rates";
+            }
+        }
+        SharedRateBook::remove(name);
+        return problem;
+#else
+        return std::string();
+#endif
+    }
+
+    // Non-finite amounts are out of range on both tryConvert overloads,
+    // including a same-currency conversion, which needs no rate.
+    std::string checkConverterAmounts() {
+        StaticRateProvider provider("USD");
+        CurrencyConverter converter(provider);
+        CurrencyId usd = provider.findCurrency("USD"), eur = provider.findCurrency("EUR");
+        const double inf = std::numeric_limits<double>::infinity();
+        for (double amount : {std::numeric_limits<double>::quiet_NaN(), inf, -inf}) {
+            for (Result<double> result : {converter.tryConvert("USD", "EUR", amount),
+                                          converter.tryConvert("USD", "USD", amount),
+                                          converter.tryConvert(usd, eur, amount)}) {
+                if (result.error() != ConversionError::AmountOutOfRange) {
+                    return "amount " + std::to_string(amount) + " gave \"" + describe(result.error()) + "\"";
+                }
+            }
+        }
+        if (converter.tryConvert("USD", "EUR", -1.0).error() != ConversionError::NegativeAmount ||
+            !converter.tryConvert(usd, eur, 10.0)) {
+            return "finite amounts are no longer converted as before";
+        }
+        return std::string();
+    }
+
+    // Requests over loopback whose amount, or converted amount, is not a
+    // finite number must come back with AmountOutOfRange, not OK.
+    std::string checkServerAmounts() {
+#ifdef CURRENCY_CONVERTER_EPOLL
+        StaticRateProvider provider("USD");
+        CurrencyConverter converter(provider);
+        ConversionServer server(converter, "127.0.0.1", 0, 1);
+
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return "cannot create a socket";
+        timeval timeout{5, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port   = htons(server.getPort());
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return "cannot connect to the server";
+        }
+
+        const double amounts[] = {std::numeric_limits<double>::quiet_NaN(),
+                                  std::numeric_limits<double>::infinity(), 1e308, 10.0};
+        std::string problem;
+        for (double amount : amounts) {
+            char request[WireProtocol::kMaxRequest];
+            std::size_t size = WireProtocol::encodeRequest(request, "USD", "INR", amount, 1);
+            WireProtocol::Response response{};
+            std::size_t got = 0;
+            if (::send(fd, request, size, MSG_NOSIGNAL) == static_cast<ssize_t>(size)) {
+                while (got < sizeof(response)) {
+                    ssize_t n = ::recv(fd, reinterpret_cast<char *>(&response) + got, sizeof(response) - got, 0);
+                    if (n <= 0) break;
+                    got += static_cast<std::size_t>(n);
+                }
+            }
+            if (got != sizeof(response)) {
+                problem = "no response from the server";
+                break;
+            }
+            auto expected = amount == 10.0 ? ConversionError::None : ConversionError::AmountOutOfRange;
+            if (response.status != static_cast<std::uint8_t>(expected)) {
+                char text[32];
+                std::snprintf(text, sizeof(text), "%g", amount);
+                problem = std::string("amount ") + text + " answered \"" +
+                          describe(static_cast<ConversionError>(response.status)) + "\"";
+                break;
+            }
+        }
+        ::close(fd);
+        return problem;
+#else
+        return std::string();
+#endif
+    }
+
+    // Rates scaled up by more than the amount can take must report
+    // AmountOutOfRange instead of overflowing; in-range ones stay exact.
+    std::string checkMinorUnitOverflow() {
+        const std::int64_t big = std::numeric_limits<std::int64_t>::max();
+        MinorUnitConversion huge(FixedRate{1000000000000000000, -18}, 0, 0);  // x 10^36
+        for (std::int64_t amount : {big, -big, std::int64_t{1}, std::int64_t{-1}}) {
+            Result<std::int64_t> result = huge.apply(amount);
+            if (result || result.error() != ConversionError::AmountOutOfRange) {
+                return "amount " + std::to_string(amount) + " was not refused";
+            }
+        }
+        if (huge.apply(0).value() != 0) return "zero did not convert to zero";
+
+        MinorUnitConversion modest(FixedRate{5, -2}, 0, 0);  // x 500
+        if (modest.apply(3).value() != 1500 || modest.apply(-3).value() != -1500) {
+            return "x500 gave a wrong result";
+        }
+        Result<std::int64_t> edge = modest.apply(big / 500 + 1);
+        if (edge || edge.error() != ConversionError::AmountOutOfRange) return "x500 overflow not refused";
+        if (modest.apply(big / 500).value() != big / 500 * 500) return "x500 at the limit failed";
+        return std::string();
+    }
+
+    // AmountText::parse must refuse what is not a finite amount, including
+    // the spellings std::from_chars accepts, and agree with from_chars on
+    // everything else.
+    std::string checkAmountText() {
+        for (const char *text : {"nan", "NaN", "-nan", "nan(123)", "inf", "-inf", "infinity",
+                                 "1e400", "-1e309", "", "-", ".", "1.2.3", "12x", " 1"}) {
+            double value = 0.0;
+            if (AmountText::parse(std::string(text), value)) {
+                return std::string("accepted \"") + text + "\"";
+            }
+        }
+        for (const char *text : {"0", "-0", "12", "1234.56", "0.1", "-0.000001", "1e6", "2.5E-3",
+                                 "9007199254740993", "123456789012345678901234", "1.7976931348623157e308",
+                                 "4.9e-324"}) {
+            double value = 0.0, expected = 0.0;
+            std::from_chars(text, text + std::strlen(text), expected);
+            if (!AmountText::parse(std::string(text), value) || !sameBits(value, expected)) {
+                return std::string("parsed \"") + text + "\" differently from from_chars";
+            }
+        }
+        return std::string();
+    }
+
+public:
+    explicit SelfTest(std::string dir = ".") : scratchDir(std::move(dir)) {}
+
+    int run(std::ostream &out) {
+        int failed = 0;
+        auto report = [&](const std::string &name, const std::function<std::string()> &check) {
+            std::string problem;
+            try {
+                problem = check();
+            } catch (const std::exception &ex) {
+                problem = std::string("threw: ") + ex.what();
+            }
+            out << (problem.empty() ? "ok    " : "FAIL  ") << name
+                << (problem.empty() ? "" : ": " + problem) << "\n";
+            failed += problem.empty() ? 0 : 1;
+        };
+
+        report("rate log: torn or corrupt last frame", [this] { return checkRateLogTail(); });
+        report("rate log: rejected update", [this] { return checkRejectedCommit(); });
+        report("rate log: failed flush", [this] { return checkFailedFlush(); });
+        report("rate series: random round trips", [this] { return checkRateSeries(); });
+        report("shared rate book: readers racing a writer", [this] { return checkSharedBookReaders(); });
+        report("shared rate book: refused update", [this] { return checkSharedBookRejects(); });
+        report("shared rate book: takeover", [this] { return checkSharedBookTakeover(); });
+        report("amount text: rejects non-finite input", [this] { return checkAmountText(); });
+        report("minor units: refuses overflowing amounts", [this] { return checkMinorUnitOverflow(); });
+        report("converter: rejects non-finite amounts", [this] { return checkConverterAmounts(); });
+        report("server: rejects non-finite amounts", [this] { return checkServerAmounts(); });
+        report("rate update: rejects bad rates", [this] { return checkRateUpdateRejects(); });
+        report("rate book file: rejects bad rates", [this] { return checkRateBookFileRejects(); });
+        report("rate book: self-pair overrides", [this] { return checkSelfPairOverrides(); });
+        report("rate book: copy-on-write versions", [this] { return checkCopyOnWriteBook(); });
+        report("triangulation: memo across edits", [this] { return checkTriangulationMemo(); });
+        return failed;
+    }
+};
+
+// Removes "name value" from args. Returns false if name is absent.
+static bool takeOption(std::vector<std::string> &args, const std::string &name, std::string &value) {
+    auto it = std::find(args.begin(), args.end(), name);
+    if (it == args.end()) return false;
+    if (it + 1 == args.end()) {
+        throw std::runtime_error(name + " needs a value");
+    }
+    value = *(it + 1);
+    args.erase(it, it + 2);
+    return true;
+}
+
+// Parses a whole-number option value no larger than max.
+static unsigned long parseCount(const std::string &name, const std::string &text,
+                                unsigned long max) {
+    unsigned long value = 0;
+    auto parsed = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (parsed.ec != std::errc() || parsed.ptr != text.data() + text.size() || value > max) {
+        throw std::runtime_error(name + " needs a number up to " + std::to_string(max));
+    }
+    return value;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (!args.empty() && args[0] == "--bench") {
+        BenchOptions options;
+        if (args.size() > 1 && args[1] == "--quick") {
+            options.universes = {7, 1000};
+            options.hitRatios = {0.0, 1.0};
+            options.opsPerThread = 200000;
+            options.latencySamples = 20000;
+            options.historyTicks = 100000;
+            options.repriceRows = 1000000;
+            options.walUpdates = 1000000;
+            options.serverSeconds = 0.5;
+            options.csvRows = 1000000;
+        }
+        BenchmarkSuite(options).run(std::cout);
+        return 0;
+    }
+
+    if (!args.empty() && args[0] == "--selftest") {
+        try {
+            return SelfTest().run(std::cout) == 0 ? 0 : 1;
+        } catch (const std::exception &ex) {
+            std::cerr << "Error: " << ex.what() << "\n";
+            return 1;
+        }
+    }
+
+    try {
+        std::string bookPath, writeBookPath, walPath, servePort, loadPort, text;
+        std::string host = "127.0.0.1";
+        bool hasBook      = takeOption(args, "--book", bookPath);
+        bool hasWriteBook = takeOption(args, "--write-book", writeBookPath);
+        bool hasWal       = takeOption(args, "--wal", walPath);
+        bool hasServe     = takeOption(args, "--serve", servePort);
+        bool hasLoad      = takeOption(args, "--load", loadPort);
+        std::string shareName, attachName;
+        bool hasShare     = takeOption(args, "--share", shareName);
+        bool hasAttach    = takeOption(args, "--attach", attachName);
+        takeOption(args, "--host", host);
+        unsigned reactors = 0;
+        if (takeOption(args, "--reactors", text)) {
+            reactors = static_cast<unsigned>(parseCount("--reactors", text, 1024));
+        }
+        unsigned threads = 0;
+        if (takeOption(args, "--threads", text)) {
+            threads = static_cast<unsigned>(parseCount("--threads", text, 4096));
+        }
+        bool batchMode = !args.empty() && args[0] == "--batch";
+        bool csvMode   = !args.empty() && args[0] == "--csv";
+        if (csvMode && args.size() < 2) throw std::runtime_error("--csv needs an input file");
+        std::FILE *csvOut = stdout;
+        if (csvMode && args.size() > 2 && args[2] != "-") {
+            csvOut = std::fopen(args[2].c_str(), "wb");
+            if (!csvOut) {
+                std::cerr << "Cannot create " << args[2] << "\n";
+                return 1;
+            }
+        }
+        // summary on stderr; the converted rows went to csvOut
+        auto finishCsv = [&](const PipelineReport &report) {
+            if (csvOut != stdout && std::fclose(csvOut) != 0) {
+                throw std::runtime_error("Cannot write " + args[2]);
+            }
+            std::cerr << "Converted " << report.rows << " rows (" << report.failures << " failed) in "
+                      << std::fixed << std::setprecision(2) << report.seconds << " s\n";
+            return report.failures == 0 ? 0 : 2;
+        };
+        std::FILE *in  = stdin;
+        if (batchMode && args.size() > 1 && args[1] != "-") {
+            in = std::fopen(args[1].c_str(), "rb");
+            if (!in) {
+                std::cerr << "Cannot open " << args[1] << "\n";
+                return 1;
+            }
+        }
+
+        if (hasLoad) {
+#ifdef CURRENCY_CONVERTER_EPOLL
+            LoadOptions load;
+            load.host = host;
+            load.port = static_cast<std::uint16_t>(parseCount("--load", loadPort, 65535));
+            if (takeOption(args, "--connections", text)) {
+                load.connections = static_cast<unsigned>(parseCount("--connections", text, 4096));
+            }
+            if (takeOption(args, "--pipeline", text)) {
+                load.pipeline = static_cast<unsigned>(parseCount("--pipeline", text, 65536));
+            }
+            if (takeOption(args, "--seconds", text)) {
+                load.seconds = static_cast<double>(parseCount("--seconds", text, 86400));
+            }
+            LoadReport report = LoadGenerator::run(load);
+            std::cout << std::fixed << std::setprecision(0) << report.requests << " requests in "
+                      << std::setprecision(2) << report.seconds << " s: " << std::setprecision(0)
+                      << report.requestsPerSec << " req/s, " << report.failures << " failed; "
+                      << load.pipeline << "-request window round trip p50 " << std::setprecision(1)
+                      << report.p50Us << " us, p99 " << report.p99Us << " us\n";
+            return report.failures == 0 ? 0 : 2;
+#else
+            throw std::runtime_error("Load generator needs Linux (epoll)");
+#endif
+        }
+
+        if (hasAttach) {
+            // a reader process: converts from the writer's segment only
+#ifdef CURRENCY_CONVERTER_POSIX
+            SharedRateProvider shared(attachName);
+            if (hasServe) {
+                ConverterApp::serve(host, static_cast<std::uint16_t>(parseCount("--serve", servePort, 65535)),
+                                    reactors, CurrencyConverter(shared));
+                return 0;
+            }
+            if (csvMode) {
+                return finishCsv(CsvPipeline::run(BasicCurrencyConverter<SharedRateProvider>(shared),
+                                                  args[1], csvOut, threads));
+            }
+            if (!batchMode) throw std::runtime_error("--attach needs --batch, --csv or --serve");
+            std::size_t failures = ConverterApp::runBatch(
+                in, stdout, BasicCurrencyConverter<SharedRateProvider>(shared));
+            if (in != stdin) std::fclose(in);
+            return failures == 0 ? 0 : 2;
+#else
+            throw std::runtime_error("Shared rate books need POSIX shared memory");
+#endif
+        }
+
+        ConverterApp app;
+        if (hasWal) {
+            app.openLog(walPath);
+        }
+        if (hasBook) {
+            app.loadRateBook(bookPath);
+        }
+        if (hasWriteBook) {
+            app.saveRateBook(writeBookPath);
+            return 0;
+        }
+        if (hasShare) {
+            app.shareRates(shareName);
+        }
+        if (hasServe) {
+            app.serve(host, static_cast<std::uint16_t>(parseCount("--serve", servePort, 65535)),
+                      reactors);
+            return 0;
+        }
+
+        if (csvMode) {
+            return finishCsv(app.convertCsv(args[1], csvOut, threads));
+        }
+        if (batchMode) {
+            std::size_t failures = app.runBatch(in, stdout);
+            if (in != stdin) std::fclose(in);
+            return failures == 0 ? 0 : 2;
+        }
+
+        app.run();
+    } catch (const std::exception &ex) {
+        std::cerr << "Error: " << ex.what() << "\n";
+        return 1;
+    }
     return 0;
 }